@@ -9,9 +9,17 @@ static const float rootcolor[] = {0.3, 0.3, 0.3, 1.0};
 static const float bordercolor[] = {0.5, 0.5, 0.5, 1.0};
 static const float focuscolor[] = {1.0, 0.0, 0.0, 1.0};
 
+/* rendering */
+static const int frameretrymax = 1000;   /* max ms between failed commits */
+static const int txntimeout = 200;       /* ms to wait for clients to resize */
+static const int suspendinterval = 1000; /* ms between frames on hidden tags */
+
 /* tagging */
 static const char *tags[] = {"1", "2", "3", "4", "5", "6", "7", "8", "9"};
 
+/* apply rules again when a client changes its title or app_id */
+static const int dynamicrules = 0;
+
 static const Rule rules[] = {
     /* app_id     title       tags mask     isfloating   monitor */
     /* examples:
@@ -30,15 +38,17 @@ static const Layout layouts[] = {
 
 /* monitors
  * The order in which monitors are defined determines their position.
- * Non-configured monitors are always added to the left. */
+ * Non-configured monitors are always added to the left.
+ * maxrender is how many ms before the next vblank rendering starts: 0 renders
+ * as soon as the output asks for a frame, -1 measures it automatically. */
 static const MonitorRule monrules[] = {
-    /* name       mfact nmaster scale layout       rotate/reflect x y */
+    /* name    mfact nmaster scale layout      rotate/reflect x y maxrender */
     /* example of a HiDPI laptop monitor:
     { "eDP-1",    0.5,  1,      2,    &layouts[0], WL_OUTPUT_TRANSFORM_NORMAL,
-    0, 0 },
+    0, 0, -1 },
     */
     /* defaults */
-    {NULL, 0.55, 1, 1, &layouts[0], WL_OUTPUT_TRANSFORM_NORMAL, 0, 0},
+    {NULL, 0.55, 1, 1, &layouts[0], WL_OUTPUT_TRANSFORM_NORMAL, 0, 0, 0},
 };
 
 /* keyboard */
@@ -10,6 +10,7 @@
 
 /* function declarations */
 extern void applybounds(Client *c, struct wlr_box *bbox);
+extern void applygeom(Client *c);
 extern void applyexclusive(struct wlr_box *usable_area, uint32_t anchor,
                            int32_t exclusive, int32_t margin_top,
                            int32_t margin_right, int32_t margin_bottom,
@@ -19,41 +20,83 @@ extern void arrange(Monitor *m);
 extern void arrangelayer(Monitor *m, struct wl_list *list,
                          struct wlr_box *usable_area, int exclusive);
 extern void arrangelayers(Monitor *m);
+extern void arrangemon(Monitor *m);
+extern void arrangemons(void *data);
+extern void attachclient(Client *c);
 extern void axisnotify(struct wl_listener *listener, void *data);
+extern void buildhits(Monitor *m);
+extern int buttonbinding(uint32_t mods, unsigned int button);
 extern void buttonpress(struct wl_listener *listener, void *data);
 extern void chvt(const Arg *arg);
 extern void cleanup(void);
+extern void cleanupipc(void);
 extern void cleanupkeyboard(struct wl_listener *listener, void *data);
+extern void cleanupkeymaps(void);
 extern void cleanupmon(struct wl_listener *listener, void *data);
+extern void cleanuppools(void);
+extern void cleanupstats(void);
+extern void cleanuptrace(void);
+extern struct wlr_surface *clientsurfaceat(Client *c, double cx, double cy,
+                                           double *sx, double *sy);
+extern void clientsurfaces(Client *c, wlr_surface_iterator_func_t fn,
+                           void *data);
 extern void closemon(Monitor *m);
 extern void commitlayersurfacenotify(struct wl_listener *listener, void *data);
 extern void commitnotify(struct wl_listener *listener, void *data);
+extern void commitsurface(struct wl_listener *listener, void *data);
+extern unsigned int countedtags(const unsigned int count[32]);
+extern void counttags(Monitor *m, Client *c, int n);
 extern void createkeyboard(struct wlr_input_device *device);
 extern void createmon(struct wl_listener *listener, void *data);
 extern void createnotify(struct wl_listener *listener, void *data);
 extern void createlayersurface(struct wl_listener *listener, void *data);
 extern void createpointer(struct wlr_input_device *device);
+extern void createsubsurface(struct wl_listener *listener, void *data);
+extern void createsurface(struct wl_listener *listener, void *data);
+extern void cullclients(Monitor *m, pixman_region32_t *opaque);
 extern void cursorframe(struct wl_listener *listener, void *data);
+extern void damagebox(struct wlr_box *box);
+extern void damageclient(Client *c, struct wlr_surface *target, int whole);
+extern void damagefocus(void);
+extern void damagelayersurface(LayerSurface *layersurface,
+                               struct wlr_surface *target, int whole);
+extern void damagemon(Monitor *m);
+extern void detachclient(Client *c);
 extern void destroylayersurfacenotify(struct wl_listener *listener, void *data);
 extern void destroynotify(struct wl_listener *listener, void *data);
+extern void destroysurface(struct wl_listener *listener, void *data);
+extern void dropbuffers(Client *c);
 extern Monitor *dirtomon(enum wlr_direction dir);
+extern void flushmotion(void);
+extern void flushstatus(void *data);
 extern void focusclient(Client *c, int lift);
 extern void focusmon(const Arg *arg);
 extern void focusstack(const Arg *arg);
 extern void fullscreennotify(struct wl_listener *listener, void *data);
 extern Client *focustop(Monitor *m);
+extern void formatstats(void (*line)(const char *, void *), void *data);
+extern void framedone(Monitor *m, struct timespec *now);
+extern Monitor *framemon(const struct wlr_box *box);
+extern void hitschanged(void);
 extern void incnmaster(const Arg *arg);
+extern void indexmons(void);
 extern void inputdevice(struct wl_listener *listener, void *data);
+extern void ipcremovemon(Monitor *m);
+extern void ipcstatus(Monitor *m, const Status *now);
 extern int keybinding(uint32_t mods, xkb_keysym_t sym);
 extern void keypress(struct wl_listener *listener, void *data);
 extern void keypressmod(struct wl_listener *listener, void *data);
+extern KeyMap *keymapfor(const struct xkb_rule_names *names);
 extern void killclient(const Arg *arg);
 extern void maplayersurfacenotify(struct wl_listener *listener, void *data);
 extern void mapnotify(struct wl_listener *listener, void *data);
+extern int monintersects(Monitor *m, const struct wlr_box *box);
 extern void monocle(Monitor *m);
 extern void motionabsolute(struct wl_listener *listener, void *data);
+extern void motionidle(void *data);
 extern void motionnotify(uint32_t time);
 extern void motionrelative(struct wl_listener *listener, void *data);
+extern void movegrab(void);
 extern void moveresize(const Arg *arg);
 extern void outputmgrapply(struct wl_listener *listener, void *data);
 extern void outputmgrapplyortest(struct wlr_output_configuration_v1 *config,
@@ -61,17 +104,44 @@ extern void outputmgrapplyortest(struct wlr_output_configuration_v1 *config,
 extern void outputmgrtest(struct wl_listener *listener, void *data);
 extern void pointerfocus(Client *c, struct wlr_surface *surface, double sx,
                          double sy, uint32_t time);
+extern void *poolalloc(Pool *p);
+extern void poolfree(Pool *p, void *obj);
+extern void presentmon(struct wl_listener *listener, void *data);
 extern void printstatus(void);
+extern void queuemotion(uint32_t time);
 extern void quit(const Arg *arg);
 extern void quitsignal(int signo);
+extern void reapplyrules(Client *c, int title);
+extern void recordack(Client *c);
+extern uint32_t recordsince(Histogram *h, const struct timespec *start);
+extern uint32_t recordtime(Histogram *h, int64_t ns);
 extern void render(struct wlr_surface *surface, int sx, int sy, void *data);
-extern void renderclients(Monitor *m, struct timespec *now);
-extern void renderlayer(struct wl_list *layer_surfaces, struct timespec *now);
+extern int renderdelay(Monitor *m);
+extern int renderframe(Monitor *m, struct timespec *now);
 extern void rendermon(struct wl_listener *listener, void *data);
+extern void rendersaved(Client *c, struct wlr_output *output, int x, int y,
+                        pixman_region32_t *damage);
+extern void renderrect(struct wlr_output *output, struct wlr_box *box,
+                       const float *color, pixman_region32_t *damage);
+extern void renderscene(Monitor *m, struct timespec *now,
+                        pixman_region32_t *below, pixman_region32_t *damage);
+extern void rendertexture(struct wlr_output *output,
+                          struct wlr_texture *texture, struct wlr_box *obox,
+                          enum wl_output_transform transform,
+                          pixman_region32_t *damage);
 extern void resize(Client *c, int x, int y, int w, int h, int interact);
+extern int repaintmon(void *data);
+extern int retryframe(void *data);
 extern void run(char *startup_cmd);
 extern void scalebox(struct wlr_box *box, float scale);
+extern int scanout(Monitor *m, struct timespec *now);
+extern void scissoroutput(struct wlr_output *output, pixman_box32_t *rect);
+extern void savebuffers(Client *c);
+extern void savestatus(Status *st, const Status *now);
+extern void scenechanged(void);
 extern Client *selclient(void);
+extern void sendframedone(struct wlr_surface *surface, int sx, int sy,
+                          void *data);
 extern void setcursor(struct wl_listener *listener, void *data);
 extern void setpsel(struct wl_listener *listener, void *data);
 extern void setsel(struct wl_listener *listener, void *data);
@@ -80,9 +150,20 @@ extern void setfullscreen(Client *c, int fullscreen);
 extern void setlayout(const Arg *arg);
 extern void setmfact(const Arg *arg);
 extern void setmon(Client *c, Monitor *m, unsigned int newtags);
+extern void setupbindings(void);
+extern void settags(Client *c, unsigned int tags);
 extern void setup(void);
+extern void setupipc(const char *display);
+extern void setuprules(void);
+extern void setupstats(void);
+extern void seturgent(Client *c, int urgent);
 extern void sigchld(int unused);
+extern void showframe(Monitor *m);
 extern void spawn(const Arg *arg);
+extern unsigned int statuschanges(const Status *st, const Status *now);
+extern void surfacedestroyed(void);
+extern void suspendclient(Client *c, int suspend);
+extern int statuswritable(int fd, uint32_t mask, void *data);
 extern void tag(const Arg *arg);
 extern void tagmon(const Arg *arg);
 extern void tile(Monitor *m);
@@ -90,19 +171,33 @@ extern void togglefloating(const Arg *arg);
 extern void togglefullscreen(const Arg *arg);
 extern void toggletag(const Arg *arg);
 extern void toggleview(const Arg *arg);
+extern TraceSpan tracebegin(const char *name);
+extern void traceend(TraceSpan *span);
+extern int tracestart(void);
+extern void tracestop(void);
+extern int tracewrite(const char *path);
+extern void trackrole(struct wl_signal *destroy, struct wl_signal *unmap);
+extern void treechanged(Client *c);
+extern void txnapply(Monitor *m);
+extern void txncheck(Monitor *m);
+extern void txncommit(void *data);
+extern int txnexpire(void *data);
+extern void txnopen(Monitor *m);
+extern void unblocksignals(void);
 extern void unmaplayersurface(LayerSurface *layersurface);
 extern void unmaplayersurfacenotify(struct wl_listener *listener, void *data);
 extern void unmapnotify(struct wl_listener *listener, void *data);
+extern void updateappid(struct wl_listener *listener, void *data);
 extern void updatemons(struct wl_listener *listener, void *data);
+extern void updatesuspended(Monitor *m);
 extern void updatetitle(struct wl_listener *listener, void *data);
 extern void urgent(struct wl_listener *listener, void *data);
 extern void view(const Arg *arg);
 extern void virtualkeyboard(struct wl_listener *listener, void *data);
 extern Client *xytoclient(double x, double y);
-extern struct wlr_surface *xytolayersurface(struct wl_list *layer_surfaces,
-                                            double x, double y, double *sx,
-                                            double *sy);
 extern Monitor *xytomon(double x, double y);
+extern struct wlr_surface *xytosurface(double x, double y, Client **pc,
+                                       double *sx, double *sy);
 extern void zoom(const Arg *arg);
 
 #ifdef XWAYLAND
@@ -112,7 +207,5 @@ extern void activatex11(struct wl_listener *listener, void *data);
 extern void configurex11(struct wl_listener *listener, void *data);
 extern void createnotifyx11(struct wl_listener *listener, void *data);
 extern Atom getatom(xcb_connection_t *xc, const char *name);
-extern void renderindependents(struct wlr_output *output, struct timespec *now);
 extern void xwaylandready(struct wl_listener *listener, void *data);
-extern Client *xytoindependent(double x, double y);
 #endif // XWAYLAND
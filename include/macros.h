@@ -16,4 +16,11 @@
 #define END(A) ((A) + LENGTH(A))
 #define TAGMASK ((1 << LENGTH(tags)) - 1)
 #define ROUND(X) ((int)((X) + 0.5))
+#define FLOOR(X) ((int)(X) - ((X) < (int)(X)))
+#define CEIL(X) ((int)(X) + ((X) > (int)(X)))
+#define TIMESPEC_NSEC(T) ((int64_t)(T)->tv_sec * 1000000000 + (T)->tv_nsec)
 #define LISTEN(E, L, H) wl_signal_add((E), ((L)->notify = (H), (L)))
+/* Records the enclosing function while tracing, see trace.c; it must come
+ * first among the declarations of a function */
+#define TRACE()                                                                \
+  TraceSpan tracespan __attribute__((cleanup(traceend))) = tracebegin(__func__)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <pixman.h>
 #include <wayland-server-core.h>
 #include <wayland-util.h>
 #include <wlr/types/wlr_box.h>
@@ -21,15 +22,105 @@ typedef union {
   const void *v;
 } Arg;
 
+typedef struct LayerSurface LayerSurface;
+typedef struct Client Client;
+
+/* Something the pointer can hit on a monitor, see xytosurface() */
+typedef struct {
+  struct wlr_box box;         /* layout-relative, covers all its surfaces */
+  LayerSurface *layersurface; /* either a layer surface */
+  Client *c;                  /* or a client or independent */
+  int covered;                /* overlaps a box above it */
+} HitBox;
+
+/* Durations in us, counted in buckets a sixteenth of a power of two wide,
+ * see recordtime() */
+typedef struct {
+  uint32_t buckets[29 * 16];
+  uint32_t count, max;
+  uint64_t sum;
+} Histogram;
+
+/* A function running while tracing, see TRACE() */
+typedef struct {
+  const char *name; /* NULL if tracing was off when it started */
+  int64_t start;    /* ns, CLOCK_MONOTONIC */
+} TraceSpan;
+
+/* A surface of a client with its offset, see clientsurfaces() */
+typedef struct {
+  struct wlr_surface *surface;
+  int x, y; /* relative to the main surface */
+} FlatSurface;
+
+/* Something drawn on a monitor, see renderscene() */
+typedef struct {
+  int type;                    /* Scene* */
+  struct wlr_box box;          /* output-local: scaled rect, or tree origin */
+  const float *color;          /* of a rect */
+  struct wlr_surface *surface; /* surface tree, unless drawn for c */
+  Client *c;                   /* not drawn while occluded */
+  int framedone;               /* m paces the surfaces, see framemon() */
+} SceneNode;
+
+/* Status of a monitor, see flushstatus(); title is only owned when the
+ * status is kept as the one last sent somewhere. */
+typedef struct {
+  int valid; /* anything was sent yet */
+  const char *title;
+  unsigned int selmon;
+  unsigned int occ, tags, sel, urg;
+  const char *layout;
+} Status;
+
 typedef struct Layout Layout;
 struct Monitor {
   struct wl_list link;
   struct wlr_output *wlr_output;
+  struct wlr_output_damage *damage; /* accumulated output-local damage */
   struct wl_listener frame;
   struct wl_listener destroy;
-  struct wlr_box m;         /* monitor area, layout-relative */
+  struct wl_listener present;
+  struct wl_event_source *repaint; /* fires the delayed render of a frame */
+  int repaintarmed;                /* repaint will render the next frame */
+  int maxrendertime;               /* ms budget before vblank, 0 off, -1 auto */
+  int64_t rendertime;              /* ns, recent peak of renderframe() */
+  struct timespec lastpresent;     /* when the last frame hit the screen */
+  int refresh;                     /* ns between vblanks, 0 if unknown */
+  struct wl_event_source *retry;   /* reschedules a frame after a failure */
+  int retrydelay;                  /* ms, grows while commits keep failing */
+  int framepending;                /* committed, waiting to be presented */
+  int frameneeded;                 /* damage is waiting for a retry */
+  unsigned int commitfails;        /* failed commits since creation */
+  struct timespec committed;       /* when the last frame was committed */
+  Histogram renderhist;            /* time spent rendering a frame */
+  Histogram presenthist;           /* from commit to presentation */
+  Histogram ackhist;               /* from configure to the commit acking it */
+  unsigned int stalled;            /* frames shown while waiting for clients */
+  unsigned int expired;            /* transactions given up on */
+  int scanout; /* a client buffer is shown without compositing */
+  int txn;     /* clients are being resized, their old state is shown */
+  int dirty;   /* needs to be arranged, see arrangemons() */
+  struct wl_event_source *txncommit; /* checks the transaction once idle */
+  struct wl_event_source *txnexpire; /* gives up waiting for the clients */
+  struct wlr_box m;         /* monitor area in the layout, see updatemons() */
   struct wlr_box w;         /* window area, layout-relative */
   struct wl_list layers[4]; // LayerSurface::link
+  struct wl_list clients;   /* Client::mlink, tiling order */
+  struct wl_list fstack;    /* Client::mflink, focus order */
+  unsigned int occ[32];     /* clients on each tag */
+  unsigned int urg[32];     /* urgent clients on each tag */
+  int nfullscreen;          /* fullscreen clients, on any tag */
+  HitBox *hits;             /* pointer hit test index, see xytosurface() */
+  int nhits, maxhits;
+  int lasthit;              /* index of the last box hit, or -1 */
+  unsigned int hitgen;      /* hits is rebuilt when this is outdated */
+  SceneNode *scene;         /* drawn bottom to top, see renderscene() */
+  int nscene, maxscene;
+  int sceneclients;         /* first node above the bottom layer */
+  unsigned int scenegen;    /* scene is rebuilt when this is outdated */
+  Status status;            /* as last printed to stdout */
+  Status ipcstatus;         /* as last sent to IPC clients */
   const Layout *lt[2];
   unsigned int seltags;
   unsigned int sellt;
@@ -53,6 +144,7 @@ typedef struct {
   enum wl_output_transform rr;
   int x;
   int y;
+  int maxrendertime;
 } MonitorRule;
 
 typedef struct {
@@ -62,10 +154,12 @@ typedef struct {
   const Arg arg;
 } Key;
 
-typedef struct {
+struct Client {
   struct wl_list link;
   struct wl_list flink;
   struct wl_list slink;
+  struct wl_list mlink;  /* Monitor::clients */
+  struct wl_list mflink; /* Monitor::fstack */
   union {
     struct wlr_xdg_surface *xdg;
     struct wlr_xwayland_surface *xwayland;
@@ -75,8 +169,15 @@ typedef struct {
   struct wl_listener unmap;
   struct wl_listener destroy;
   struct wl_listener set_title;
+  struct wl_listener set_app_id;
   struct wl_listener fullscreen;
-  struct wlr_box geom; /* layout-relative, includes border */
+  struct wlr_box geom;    /* layout-relative, includes border */
+  struct wlr_box current; /* geom as shown, lags behind during transactions */
+  struct wl_list saved;   /* SavedBuffer::link, shown during transactions */
+  int savedwidth, savedheight; /* size of the saved main surface */
+  FlatSurface *surfaces;       /* subsurfaces and popups, bottom to top */
+  int nsurfaces, maxsurfaces;
+  unsigned int treegen; /* surfaces is rebuilt when this is outdated */
   Monitor *mon;
 
 #ifdef XWAYLAND
@@ -88,15 +189,22 @@ typedef struct {
   int bw;
   unsigned int tags;
   int isfloating, isurgent;
+  unsigned int ruletags; /* outcome of the rules last applied */
+  int rulefloating;
+  Monitor *rulemon; /* NULL unless a rule names the monitor */
+  int occluded;    /* hidden behind opaque clients in the current frame */
+  int suspended;   /* on hidden tags, see suspendclient() */
   uint32_t resize; /* configure serial of a pending resize */
+  struct timespec configured; /* when the pending resize was asked for */
+  uint32_t acklast, ackmax;   /* us from configure to ack, see recordack() */
   int prevx;
   int prevy;
   int prevwidth;
   int prevheight;
   int isfullscreen;
-} Client;
+};
 
-typedef struct {
+struct LayerSurface {
   struct wlr_layer_surface_v1 *layer_surface;
   struct wl_list link;
 
@@ -107,7 +215,44 @@ typedef struct {
 
   struct wlr_box geo;
   enum zwlr_layer_shell_v1_layer layer;
-} LayerSurface;
+};
+
+/* Tracks commits of every wlr_surface so that the area it covers can be
+ * damaged on the outputs showing it, whatever role the surface has. */
+typedef struct {
+  struct wlr_surface *surface;
+  struct wl_listener commit;
+  struct wl_listener destroy;
+  struct wl_listener new_subsurface;
+} SurfaceDamage;
+
+/* Watches a subsurface or popup, whose wl_surface outlives its role, so that
+ * the client trees stop listing it once it is gone, see trackrole(). */
+typedef struct {
+  struct wl_listener destroy;
+  struct wl_listener unmap;
+} SurfaceRole;
+
+/* A client buffer kept alive so that the client can be drawn as it was
+ * before a transaction while it prepares its new size. */
+typedef struct {
+  struct wl_list link;
+  struct wlr_client_buffer *buffer;
+  int x, y; /* relative to the client's main surface */
+  int width, height;
+  enum wl_output_transform transform;
+} SavedBuffer;
+
+/* Objects of one type carved out of cache-aligned slabs, see pool.c */
+typedef struct Pool {
+  const char *name;
+  size_t size;       /* of one object */
+  struct Pool *next; /* in pools, once it has a slab */
+  void *free;        /* free objects, linked through their first word */
+  void *slabs;       /* linked through their first word */
+  size_t nslabs, nfree, live;
+  unsigned long allocs; /* since startup */
+} Pool;
 
 typedef struct {
   unsigned int mod;
@@ -118,6 +263,20 @@ typedef struct {
 
 /* enums */
 enum { CurNormal, CurMove, CurResize }; /* cursor */
+enum {
+  SceneRect,     /* border */
+  SceneSurfaces, /* surface tree */
+  SceneSaved,    /* buffers saved during a transaction */
+  SceneFrame     /* frame callbacks only, for a client not shown yet */
+};               /* scene nodes */
+enum {
+  StatusMonitor,
+  StatusTitle,
+  StatusFocus,
+  StatusTags,
+  StatusLayout,
+  StatusLast
+}; /* parts of the status, also IPC event classes */
 #ifdef XWAYLAND
 enum {
   NetWMWindowTypeDialog,
@@ -134,6 +293,22 @@ typedef struct {
   struct wl_listener destroy;
 } Decoration;
 
+/* Longest IPC message either way, without its length */
+#define IPCMSGSIZE 4096
+
+/* A connection to the IPC socket, see ipc.c */
+typedef struct {
+  struct wl_list link;
+  int fd;
+  struct wl_event_source *source;
+  unsigned int events; /* subscribed Status* classes, 1 << class */
+  char in[4 + IPCMSGSIZE]; /* messages are read into this until complete */
+  size_t inlen;
+  char *out; /* messages waiting for the client to read them */
+  size_t outlen, outsize;
+  int dead; /* shut down, freed once its source reports the hangup */
+} IpcClient;
+
 typedef struct {
   struct wl_list link;
   struct wlr_input_device *device;
@@ -143,6 +318,16 @@ typedef struct {
   struct wl_listener destroy;
 } Keyboard;
 
+/* A keymap compiled from xkb rule names, shared by the keyboards using it.
+ * Physical keyboards are added to group; kb listens to its events. */
+typedef struct {
+  struct wl_list link;
+  struct xkb_rule_names names;
+  struct xkb_keymap *keymap;
+  struct wlr_keyboard_group *group;
+  Keyboard kb;
+} KeyMap;
+
 typedef struct {
   uint32_t singular_anchor;
   uint32_t anchor_triplet;
@@ -156,5 +341,7 @@ typedef struct {
 struct render_data {
   struct wlr_output *output;
   struct timespec *when;
-  int x, y; /* layout-relative */
+  pixman_region32_t *damage; /* output-local, scaled */
+  int x, y;                  /* output-local, unscaled */
+  int framedone;             /* output paces the surfaces, see framemon() */
 };
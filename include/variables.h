@@ -14,7 +14,7 @@ extern struct wlr_compositor *compositor;
 
 extern struct wlr_xdg_shell *xdg_shell;
 extern struct wlr_xdg_activation_v1 *activation;
-extern struct wl_list clients; /* tiling order */
+extern struct wl_list clients; /* all managed clients */
 extern struct wl_list fstack;  /* focus order */
 extern struct wl_list stack;   /* stacking z-order */
 extern struct wl_list independents;
@@ -35,11 +35,24 @@ extern struct wl_list keyboards;
 extern unsigned int cursor_mode;
 extern Client *grabc;
 extern int grabcx, grabcy; /* client-relative */
+extern int grabmoved;      /* grabc follows the cursor on the next frame */
+extern struct wl_event_source *pendingmotion; /* see flushmotion() */
+extern uint32_t motiontime;
 
 extern struct wlr_output_layout *output_layout;
 extern struct wlr_box sgeom;
 extern struct wl_list mons;
 extern Monitor *selmon;
+extern struct wl_event_source *pendingarrange; /* see arrangemons() */
+extern struct wl_event_source *pendingstatus;  /* see flushstatus() */
+
+extern Pool *pools;
+extern Pool clientpool;
+extern Pool keyboardpool;
+extern Pool layerpool;
+extern Pool monpool;
+extern Pool rolepool;
+extern Pool surfacepool;
 
 /* global event handlers */
 extern struct wl_listener cursor_axis;
@@ -51,6 +64,7 @@ extern struct wl_listener layout_change;
 extern struct wl_listener new_input;
 extern struct wl_listener new_virtual_keyboard;
 extern struct wl_listener new_output;
+extern struct wl_listener new_surface;
 extern struct wl_listener new_xdg_surface;
 extern struct wl_listener new_layer_shell_surface;
 extern struct wl_listener output_mgr_apply;
@@ -0,0 +1,100 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include <stdlib.h>
+#include <wlr/types/wlr_keyboard.h>
+
+/*
+ * keys[] and buttons[] are sorted once at startup by their cleaned modifiers
+ * and key, so that an event is looked up with a binary search instead of a
+ * scan over the whole table. Entries with the same binding keep their order
+ * in the table.
+ */
+
+/* Sort key of a binding: cleaned modifiers first, then the key or button */
+#define BINDING(MOD, KEY) ((uint64_t)CLEANMASK(MOD) << 32 | (uint32_t)(KEY))
+
+static const Key *keyindex[LENGTH(keys)];
+static size_t nkeys;
+static const Button *buttonindex[LENGTH(buttons)];
+static size_t nbuttons;
+
+static int keycmp(const void *a, const void *b) {
+  const Key *ka = *(const Key **)a, *kb = *(const Key **)b;
+  uint64_t ba = BINDING(ka->mod, ka->keysym), bb = BINDING(kb->mod, kb->keysym);
+
+  if (ba != bb)
+    return ba < bb ? -1 : 1;
+  return ka < kb ? -1 : ka > kb;
+}
+
+static int buttoncmp(const void *a, const void *b) {
+  const Button *ba = *(const Button **)a, *bb = *(const Button **)b;
+  uint64_t ka = BINDING(ba->mod, ba->button), kb = BINDING(bb->mod, bb->button);
+
+  if (ka != kb)
+    return ka < kb ? -1 : 1;
+  return ba < bb ? -1 : ba > bb;
+}
+
+int buttonbinding(uint32_t mods, unsigned int button) {
+  /* Only the first binding of a button runs, as it always has */
+  uint64_t binding = BINDING(mods, button);
+  size_t lo = 0, hi = nbuttons, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (BINDING(buttonindex[mid]->mod, buttonindex[mid]->button) < binding)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == nbuttons ||
+      BINDING(buttonindex[lo]->mod, buttonindex[lo]->button) != binding)
+    return 0;
+  buttonindex[lo]->func(&buttonindex[lo]->arg);
+  return 1;
+}
+
+int keybinding(uint32_t mods, xkb_keysym_t sym) {
+  /*
+   * Here we handle compositor keybindings. This is when the compositor is
+   * processing keys, rather than passing them on to the client for its own
+   * processing.
+   */
+  uint64_t binding = BINDING(mods, sym);
+  size_t lo = 0, hi = nkeys, mid;
+  int handled = 0;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (BINDING(keyindex[mid]->mod, keyindex[mid]->keysym) < binding)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  /* Every handler bound to the same keys runs */
+  for (; lo < nkeys &&
+         BINDING(keyindex[lo]->mod, keyindex[lo]->keysym) == binding;
+       lo++) {
+    keyindex[lo]->func(&keyindex[lo]->arg);
+    handled = 1;
+  }
+  return handled;
+}
+
+void setupbindings(void) {
+  const Key *k;
+  const Button *b;
+
+  for (k = keys; k < END(keys); k++) {
+    if (k->func)
+      keyindex[nkeys++] = k;
+  }
+  qsort(keyindex, nkeys, sizeof(*keyindex), keycmp);
+  for (b = buttons; b < END(buttons); b++) {
+    if (b->func)
+      buttonindex[nbuttons++] = b;
+  }
+  qsort(buttonindex, nbuttons, sizeof(*buttonindex), buttoncmp);
+}
@@ -0,0 +1,241 @@
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/region.h>
+
+#include "client.h"
+
+/* Used to carry the damage target through the surface iterators */
+struct damage_data {
+  Monitor *m;
+  struct wlr_surface *target; /* only damage this surface, NULL for all */
+  int x, y;                   /* layout-relative */
+  int whole;
+};
+
+/* Client whose border is currently drawn with focuscolor */
+static Client *highlighted;
+
+static void damagesurface(struct wlr_surface *surface, int sx, int sy,
+                          void *data) {
+  struct damage_data *ddata = data;
+  Monitor *m = ddata->m;
+  struct wlr_box box = {
+      .x = ddata->x + sx,
+      .y = ddata->y + sy,
+      .width = MAX(surface->current.width, surface->previous.width),
+      .height = MAX(surface->current.height, surface->previous.height),
+  };
+  struct wlr_box overlap;
+  pixman_region32_t damage;
+  int scale = CEIL(m->wlr_output->scale);
+
+  if (ddata->target && surface != ddata->target)
+    return;
+  if (!wlr_box_intersection(&overlap, &box, &m->m))
+    return;
+
+  /* Move into output-local coordinates and apply the output scale; the
+   * output damage clips what lies outside of m */
+  box.x -= m->m.x;
+  box.y -= m->m.y;
+  scalebox(&box, m->wlr_output->scale);
+
+  if (ddata->whole || surface->current.width != surface->previous.width ||
+      surface->current.height != surface->previous.height) {
+    wlr_output_damage_add_box(m->damage, &box);
+  } else if (pixman_region32_not_empty(&surface->buffer_damage)) {
+    pixman_region32_init(&damage);
+    wlr_surface_get_effective_damage(surface, &damage);
+    wlr_region_scale(&damage, &damage, m->wlr_output->scale);
+    /* Scaled damage may land between pixels; grow it to cover them */
+    if (scale > surface->current.scale)
+      wlr_region_expand(&damage, &damage, scale - surface->current.scale);
+    pixman_region32_translate(&damage, box.x, box.y);
+    wlr_output_damage_add(m->damage, &damage);
+    pixman_region32_fini(&damage);
+  }
+
+  /* Even an undamaged commit may carry a frame callback the client waits on */
+  wlr_output_schedule_frame(m->wlr_output);
+}
+
+void damagebox(struct wlr_box *box) {
+  Monitor *m;
+  struct wlr_box obox;
+
+  wl_list_for_each(m, &mons, link) {
+    if (!m->wlr_output->enabled || !wlr_box_intersection(&obox, box, &m->m))
+      continue;
+    obox = *box;
+    obox.x -= m->m.x;
+    obox.y -= m->m.y;
+    scalebox(&obox, m->wlr_output->scale);
+    wlr_output_damage_add_box(m->damage, &obox);
+  }
+}
+
+void damageclient(Client *c, struct wlr_surface *target, int whole) {
+  Monitor *m;
+  struct damage_data ddata = {.target = target, .whole = whole};
+
+  if (client_is_unmanaged(c)) {
+#ifdef XWAYLAND
+    ddata.x = c->surface.xwayland->x;
+    ddata.y = c->surface.xwayland->y;
+#endif
+  } else {
+    /* Clients on hidden tags are not shown, so there is nothing to repaint */
+    if (!c->mon || !VISIBLEON(c, c->mon))
+      return;
+    ddata.x = c->current.x + c->bw;
+    ddata.y = c->current.y + c->bw;
+    /* The border is not part of any surface */
+    if (whole)
+      damagebox(&c->current);
+  }
+
+  wl_list_for_each(m, &mons, link) {
+    if (!m->wlr_output->enabled)
+      continue;
+    ddata.m = m;
+    client_for_each_surface(c, damagesurface, &ddata);
+  }
+}
+
+void damagefocus(void) {
+  /* Border colors depend on selclient(), which changes with focus as well
+   * as with selmon; repaint the borders that changed color. */
+  Client *sel = selclient();
+
+  if (sel == highlighted)
+    return;
+  if (highlighted && highlighted->mon)
+    damagebox(&highlighted->current);
+  if (sel)
+    damagebox(&sel->current);
+  highlighted = sel;
+  scenechanged();
+}
+
+void damagelayersurface(LayerSurface *layersurface, struct wlr_surface *target,
+                        int whole) {
+  struct wlr_layer_surface_v1 *wlr_layer_surface = layersurface->layer_surface;
+  struct damage_data ddata = {
+      .target = target,
+      .whole = whole,
+      .x = layersurface->geo.x,
+      .y = layersurface->geo.y,
+  };
+
+  if (!wlr_layer_surface->output ||
+      !(ddata.m = wlr_layer_surface->output->data))
+    return;
+  wlr_surface_for_each_surface(wlr_layer_surface->surface, damagesurface,
+                               &ddata);
+}
+
+void damagemon(Monitor *m) { wlr_output_damage_add_whole(m->damage); }
+
+static int resized(struct wlr_surface *surface) {
+  return surface->current.width != surface->previous.width ||
+         surface->current.height != surface->previous.height;
+}
+
+/* new_surface */
+void createsurface(struct wl_listener *listener, void *data) {
+  TRACE();
+  struct wlr_surface *surface = data;
+  SurfaceDamage *sd = poolalloc(&surfacepool);
+
+  sd->surface = surface;
+  LISTEN(&surface->events.commit, &sd->commit, commitsurface);
+  LISTEN(&surface->events.destroy, &sd->destroy, destroysurface);
+  LISTEN(&surface->events.new_subsurface, &sd->new_subsurface,
+         createsubsurface);
+}
+
+void commitsurface(struct wl_listener *listener, void *data) {
+  TRACE();
+  SurfaceDamage *sd = wl_container_of(listener, sd, commit);
+  struct wlr_surface *root = sd->surface;
+  struct wlr_xdg_surface *xdg;
+  struct wlr_layer_surface_v1 *wlr_layer_surface;
+  Client *c;
+#ifdef XWAYLAND
+  struct wlr_xwayland_surface *xsurface;
+  struct wlr_box box;
+#endif
+
+  /* Walk up subsurfaces and popups to the surface that owns the tree */
+  for (;;) {
+    root = wlr_surface_get_root_surface(root);
+    if (!wlr_surface_is_xdg_surface(root))
+      break;
+    xdg = wlr_xdg_surface_from_wlr_surface(root);
+    if (xdg->role != WLR_XDG_SURFACE_ROLE_POPUP || !xdg->popup->parent)
+      break;
+    root = xdg->popup->parent;
+  }
+
+  if (wlr_surface_is_xdg_surface(root)) {
+    xdg = wlr_xdg_surface_from_wlr_surface(root);
+    if (xdg->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL || !(c = xdg->data))
+      return;
+    /* Subsurfaces and popups only change on commits */
+    treechanged(c);
+    if (!xdg->mapped)
+      return;
+    damageclient(c, sd->surface, 0);
+    /* Borders are drawn around the size the client committed */
+    if (sd->surface == root && resized(sd->surface))
+      scenechanged();
+  } else if (wlr_surface_is_layer_surface(root)) {
+    wlr_layer_surface = wlr_layer_surface_v1_from_wlr_surface(root);
+    if (wlr_layer_surface->data && wlr_layer_surface->mapped) {
+      damagelayersurface(wlr_layer_surface->data, sd->surface, 0);
+      /* Resized surfaces and popups change where the pointer can hit it */
+      if (sd->surface != root || resized(sd->surface))
+        hitschanged();
+    }
+#ifdef XWAYLAND
+  } else if (wlr_surface_is_xwayland_surface(root)) {
+    xsurface = wlr_xwayland_surface_from_wlr_surface(root);
+    if (!(c = xsurface->data))
+      return;
+    treechanged(c);
+    if (!xsurface->mapped)
+      return;
+    if (client_is_unmanaged(c)) {
+      /* Independents move by themselves; repaint where they used to be */
+      box = (struct wlr_box){xsurface->x, xsurface->y, xsurface->width,
+                             xsurface->height};
+      if (memcmp(&box, &c->geom, sizeof(box))) {
+        damagebox(&c->geom);
+        c->geom = box;
+        damageclient(c, NULL, 1);
+        hitschanged();
+        return;
+      }
+    }
+    damageclient(c, sd->surface, 0);
+    if (sd->surface == root && resized(sd->surface))
+      scenechanged();
+#endif
+  }
+}
+
+void destroysurface(struct wl_listener *listener, void *data) {
+  TRACE();
+  SurfaceDamage *sd = wl_container_of(listener, sd, destroy);
+
+  wl_list_remove(&sd->commit.link);
+  wl_list_remove(&sd->destroy.link);
+  wl_list_remove(&sd->new_subsurface.link);
+  surfacedestroyed();
+  poolfree(&surfacepool, sd);
+}
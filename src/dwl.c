@@ -5,9 +5,11 @@
 
 #include <linux/input-event-codes.h>
 
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -18,6 +20,7 @@
 #include <wlr/backend.h>
 #include <wlr/backend/libinput.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_control_v1.h>
@@ -26,8 +29,10 @@
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_primary_selection_v1.h>
@@ -42,6 +47,7 @@
 #include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include <xkbcommon/xkbcommon.h>
 
 #ifdef XWAYLAND
@@ -137,35 +143,24 @@ void applyexclusive(struct wlr_box *usable_area, uint32_t anchor,
   }
 }
 
-void applyrules(Client *c) {
-  /* rule matching */
-  const char *appid, *title;
-  unsigned int i, newtags = 0;
-  const Rule *r;
-  Monitor *mon = selmon, *m;
-
-  c->isfloating = client_is_float_type(c);
-  if (!(appid = client_get_appid(c)))
-    appid = broken;
-  if (!(title = client_get_title(c)))
-    title = broken;
-
-  for (r = rules; r < END(rules); r++) {
-    if ((!r->title || strstr(title, r->title)) &&
-        (!r->id || strstr(appid, r->id))) {
-      c->isfloating = r->isfloating;
-      newtags |= r->tags;
-      i = 0;
-      wl_list_for_each(m, &mons, link) if (r->monitor == i++) mon = m;
-    }
-  }
-  setmon(c, mon, newtags);
+void attachclient(Client *c) {
+  /* Add c to the client indices of c->mon */
+  Monitor *m = c->mon;
+
+  wl_list_insert(&m->clients, &c->mlink);
+  wl_list_insert(&m->fstack, &c->mflink);
+  counttags(m, c, 1);
+  m->nfullscreen += c->isfullscreen;
 }
 
 void arrange(Monitor *m) {
-  if (m->lt[m->sellt]->arrange)
-    m->lt[m->sellt]->arrange(m);
-  /* TODO recheck pointer focus here... or in resize()? */
+  /* A single event often arranges the same monitor several times; lay it
+   * out only once, with its final state, when the event loop is idle. */
+  m->dirty = 1;
+  hitschanged();
+  if (!pendingarrange)
+    pendingarrange = wl_event_loop_add_idle(wl_display_get_event_loop(dpy),
+                                            arrangemons, NULL);
 }
 
 void arrangelayer(Monitor *m, struct wl_list *list, struct wlr_box *usable_area,
@@ -233,6 +228,11 @@ void arrangelayer(Monitor *m, struct wl_list *list, struct wlr_box *usable_area,
       wlr_layer_surface_v1_close(wlr_layer_surface);
       continue;
     }
+    if (memcmp(&box, &layersurface->geo, sizeof(box))) {
+      damagebox(&layersurface->geo);
+      damagebox(&box);
+      hitschanged();
+    }
     layersurface->geo = box;
 
     if (state->exclusive_zone > 0)
@@ -244,6 +244,7 @@ void arrangelayer(Monitor *m, struct wl_list *list, struct wlr_box *usable_area,
 }
 
 void arrangelayers(Monitor *m) {
+  TRACE();
   struct wlr_box usable_area = m->m;
   uint32_t layers_above_shell[] = {
       ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
@@ -292,43 +293,108 @@ void arrangelayers(Monitor *m) {
   }
 }
 
+void arrangemon(Monitor *m) {
+  /* Visibility and geometry of any client on m may change; the new
+   * geometry is shown once the clients are done resizing, see txnopen() */
+  TRACE();
+  m->dirty = 0;
+  damagemon(m);
+  txnopen(m);
+  updatesuspended(m);
+  if (m->lt[m->sellt]->arrange)
+    m->lt[m->sellt]->arrange(m);
+  /* TODO recheck pointer focus here... or in resize()? */
+}
+
+void arrangemons(void *data) {
+  TRACE();
+  Monitor *m;
+
+  pendingarrange = NULL;
+  wl_list_for_each(m, &mons, link) {
+    if (m->dirty)
+      arrangemon(m);
+  }
+}
+
 void chvt(const Arg *arg) {
   wlr_session_change_vt(wlr_backend_get_session(backend), arg->ui);
 }
 
+unsigned int countedtags(const unsigned int count[32]) {
+  /* Mask of the tags whose count is not zero */
+  unsigned int i, tags = 0;
+
+  for (i = 0; i < 32; i++) {
+    if (count[i])
+      tags |= 1u << i;
+  }
+  return tags;
+}
+
+void counttags(Monitor *m, Client *c, int n) {
+  /* Add n to the per-tag counts of m for every tag of c */
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(m->occ); i++) {
+    if (!(c->tags & 1u << i))
+      continue;
+    m->occ[i] += n;
+    if (c->isurgent)
+      m->urg[i] += n;
+  }
+}
+
 void cleanup(void) {
+  cleanupipc();
+  cleanupstats();
 #ifdef XWAYLAND
   wlr_xwayland_destroy(xwayland);
 #endif
   wl_display_destroy_clients(dpy);
 
   wlr_backend_destroy(backend);
+  cleanupkeymaps();
   wlr_xcursor_manager_destroy(cursor_mgr);
   wlr_cursor_destroy(cursor);
   wlr_output_layout_destroy(output_layout);
   wlr_seat_destroy(seat);
   wl_display_destroy(dpy);
+  cleanuppools();
+  cleanuptrace();
 }
 
 void cleanupkeyboard(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_input_device *device = data;
   Keyboard *kb = device->data;
 
+  if (device->keyboard->group)
+    wlr_keyboard_group_remove_keyboard(device->keyboard->group,
+                                       device->keyboard);
   wl_list_remove(&kb->link);
   wl_list_remove(&kb->modifiers.link);
   wl_list_remove(&kb->key.link);
   wl_list_remove(&kb->destroy.link);
-  free(kb);
+  poolfree(&keyboardpool, kb);
 }
 
 void cleanupmon(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_output *wlr_output = data;
   Monitor *m = wlr_output->data;
   int nmons, i = 0;
 
   wl_list_remove(&m->destroy.link);
   wl_list_remove(&m->frame.link);
+  wl_list_remove(&m->present.link);
+  wl_event_source_remove(m->repaint);
+  m->repaintarmed = 0;
   wl_list_remove(&m->link);
+  indexmons();
+  ipcremovemon(m);
+  wl_event_source_remove(m->retry);
+  wlr_output_damage_destroy(m->damage);
   wlr_output_layout_remove(output_layout, m->wlr_output);
 
   nmons = wl_list_length(&mons);
@@ -337,7 +403,14 @@ void cleanupmon(struct wl_listener *listener, void *data) {
   while (!selmon->wlr_output->enabled && i++ < nmons);
   focusclient(focustop(selmon), 1);
   closemon(m);
-  free(m);
+  if (m->txncommit)
+    wl_event_source_remove(m->txncommit);
+  wl_event_source_remove(m->txnexpire);
+  free(m->hits);
+  free(m->scene);
+  free((char *)m->status.title);
+  free((char *)m->ipcstatus.title);
+  poolfree(&monpool, m);
 }
 
 void closemon(Monitor *m) {
@@ -350,10 +423,13 @@ void closemon(Monitor *m) {
              c->geom.height, 0);
     if (c->mon == m)
       setmon(c, selmon, c->tags);
+    if (c->rulemon == m)
+      c->rulemon = NULL;
   }
 }
 
 void commitlayersurfacenotify(struct wl_listener *listener, void *data) {
+  TRACE();
   LayerSurface *layersurface =
       wl_container_of(listener, layersurface, surface_commit);
   struct wlr_layer_surface_v1 *wlr_layer_surface = layersurface->layer_surface;
@@ -367,6 +443,7 @@ void commitlayersurfacenotify(struct wl_listener *listener, void *data) {
   arrangelayers(m);
 
   if (layersurface->layer != wlr_layer_surface->current.layer) {
+    damagelayersurface(layersurface, NULL, 1);
     wl_list_remove(&layersurface->link);
     wl_list_insert(&m->layers[wlr_layer_surface->current.layer],
                    &layersurface->link);
@@ -375,36 +452,46 @@ void commitlayersurfacenotify(struct wl_listener *listener, void *data) {
 }
 
 void commitnotify(struct wl_listener *listener, void *data) {
+  TRACE();
   Client *c = wl_container_of(listener, c, commit);
 
   /* mark a pending resize as completed */
-  if (c->resize && c->resize <= c->surface.xdg->configure_serial)
+  if (c->resize && c->resize <= c->surface.xdg->configure_serial) {
     c->resize = 0;
+    if (c->mon) {
+      recordack(c);
+      txncheck(c->mon);
+    }
+  }
 }
 
 void createkeyboard(struct wlr_input_device *device) {
-  struct xkb_context *context;
-  struct xkb_keymap *keymap;
-  Keyboard *kb = device->data = calloc(1, sizeof(*kb));
+  Keyboard *kb = device->data = poolalloc(&keyboardpool);
+  KeyMap *km = keymapfor(&xkb_rules);
   kb->device = device;
 
-  /* Prepare an XKB keymap and assign it to the keyboard. */
-  context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-  keymap =
-      xkb_map_new_from_names(context, &xkb_rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-  wlr_keyboard_set_keymap(device->keyboard, keymap);
-  xkb_keymap_unref(keymap);
-  xkb_context_unref(context);
+  /* Assign the shared XKB keymap to the keyboard. */
+  wlr_keyboard_set_keymap(device->keyboard, km->keymap);
   wlr_keyboard_set_repeat_info(device->keyboard, repeat_rate, repeat_delay);
 
-  /* Here we set up listeners for keyboard events. */
-  LISTEN(&device->keyboard->events.modifiers, &kb->modifiers, keypressmod);
-  LISTEN(&device->keyboard->events.key, &kb->key, keypress);
+  /*
+   * Virtual keyboards may upload a keymap of their own, which the group
+   * would push onto every other keyboard in it, so they stay on their own.
+   * The events of physical keyboards come from the group instead.
+   */
+  if (!wlr_input_device_get_virtual_keyboard(device) &&
+      wlr_keyboard_group_add_keyboard(km->group, device->keyboard)) {
+    wl_list_init(&kb->modifiers.link);
+    wl_list_init(&kb->key.link);
+    wlr_seat_set_keyboard(seat, km->group->input_device);
+  } else {
+    /* Here we set up listeners for keyboard events. */
+    LISTEN(&device->keyboard->events.modifiers, &kb->modifiers, keypressmod);
+    LISTEN(&device->keyboard->events.key, &kb->key, keypress);
+    wlr_seat_set_keyboard(seat, device);
+  }
   LISTEN(&device->events.destroy, &kb->destroy, cleanupkeyboard);
 
-  wlr_seat_set_keyboard(seat, device);
-
   /* And add the keyboard to our list of keyboards */
   wl_list_insert(&keyboards, &kb->link);
 }
@@ -431,7 +518,116 @@ void createpointer(struct wlr_input_device *device) {
   wlr_cursor_attach_input_device(cursor, device);
 }
 
+/* Used to collect output-local regions from the surface iterators */
+struct cull_data {
+  pixman_region32_t *region;
+  double x, y; /* output-local, unscaled */
+  float scale;
+};
+
+static void addsurfacebox(struct wlr_surface *surface, int sx, int sy,
+                          void *data) {
+  struct cull_data *cdata = data;
+  struct wlr_box box = {
+      .x = cdata->x + sx,
+      .y = cdata->y + sy,
+      .width = surface->current.width,
+      .height = surface->current.height,
+  };
+
+  scalebox(&box, cdata->scale);
+  pixman_region32_union_rect(cdata->region, cdata->region, box.x, box.y,
+                             box.width, box.height);
+}
+
+static void addopaque(struct cull_data *cdata, pixman_box32_t *rects,
+                      int nrects) {
+  /* Scale inwards, so that pixels only partly covered by an opaque rect at
+   * fractional scales are not taken as covered. */
+  int i, x1, y1, x2, y2;
+
+  for (i = 0; i < nrects; i++) {
+    x1 = CEIL((cdata->x + rects[i].x1) * cdata->scale);
+    y1 = CEIL((cdata->y + rects[i].y1) * cdata->scale);
+    x2 = FLOOR((cdata->x + rects[i].x2) * cdata->scale);
+    y2 = FLOOR((cdata->y + rects[i].y2) * cdata->scale);
+    if (x2 > x1 && y2 > y1)
+      pixman_region32_union_rect(cdata->region, cdata->region, x1, y1,
+                                 x2 - x1, y2 - y1);
+  }
+}
+
+void cullclients(Monitor *m, pixman_region32_t *opaque) {
+  /* Walk the stack front-to-back, marking clients whose surfaces, popups
+   * included, are hidden completely behind opaque clients above them, and
+   * collect the area of m covered by opaque clients in opaque. */
+  Client *c;
+  struct wlr_surface *surface;
+  struct wlr_texture *texture;
+  pixman_region32_t extents;
+  pixman_box32_t box, *rects;
+  struct wlr_box border;
+  int nrects;
+  struct cull_data cdata = {.scale = m->wlr_output->scale};
+
+  pixman_region32_init(&extents);
+
+  wl_list_for_each(c, &stack, slink) {
+    c->occluded = 0;
+    if (!VISIBLEON(c, c->mon) || !c->current.width ||
+        !monintersects(m, &c->current))
+      continue;
+    /* Saved buffers are drawn as they are and never cull anything */
+    if (!wl_list_empty(&c->saved))
+      continue;
+
+    /* Everything the client draws, border included */
+    pixman_region32_clear(&extents);
+    cdata.region = &extents;
+    border = (struct wlr_box){c->current.x - m->m.x, c->current.y - m->m.y,
+                              c->current.width, c->current.height};
+    scalebox(&border, cdata.scale);
+    pixman_region32_union_rect(&extents, &extents, border.x, border.y,
+                               border.width, border.height);
+    cdata.x = c->current.x - m->m.x + c->bw;
+    cdata.y = c->current.y - m->m.y + c->bw;
+    clientsurfaces(c, addsurfacebox, &cdata);
+
+    pixman_region32_subtract(&extents, &extents, opaque);
+    if (!pixman_region32_not_empty(&extents)) {
+      c->occluded = 1;
+      continue;
+    }
+
+    /* Buffers without alpha are opaque as a whole; otherwise trust the
+     * opaque region the client declared for its main surface. */
+    surface = client_surface(c);
+    cdata.region = opaque;
+    if ((texture = wlr_surface_get_texture(surface)) &&
+        wlr_texture_is_opaque(texture)) {
+      box = (pixman_box32_t){0, 0, surface->current.width,
+                             surface->current.height};
+      addopaque(&cdata, &box, 1);
+    } else {
+      rects = pixman_region32_rectangles(&surface->opaque_region, &nrects);
+      addopaque(&cdata, rects, nrects);
+    }
+  }
+  pixman_region32_fini(&extents);
+}
+
+void detachclient(Client *c) {
+  /* Remove c from the client indices of c->mon */
+  Monitor *m = c->mon;
+
+  wl_list_remove(&c->mlink);
+  wl_list_remove(&c->mflink);
+  counttags(m, c, -1);
+  m->nfullscreen -= c->isfullscreen;
+}
+
 void destroylayersurfacenotify(struct wl_listener *listener, void *data) {
+  TRACE();
   LayerSurface *layersurface = wl_container_of(listener, layersurface, destroy);
 
   if (layersurface->layer_surface->mapped)
@@ -447,16 +643,18 @@ void destroylayersurfacenotify(struct wl_listener *listener, void *data) {
       arrangelayers(m);
     layersurface->layer_surface->output = NULL;
   }
-  free(layersurface);
+  poolfree(&layerpool, layersurface);
 }
 
 void destroynotify(struct wl_listener *listener, void *data) {
   /* Called when the surface is destroyed and should never be shown again. */
+  TRACE();
   Client *c = wl_container_of(listener, c, destroy);
   wl_list_remove(&c->map.link);
   wl_list_remove(&c->unmap.link);
   wl_list_remove(&c->destroy.link);
   wl_list_remove(&c->set_title.link);
+  wl_list_remove(&c->set_app_id.link);
   wl_list_remove(&c->fullscreen.link);
 #ifdef XWAYLAND
   if (c->type == X11Managed)
@@ -464,7 +662,8 @@ void destroynotify(struct wl_listener *listener, void *data) {
   else if (c->type == XDGShell)
 #endif
     wl_list_remove(&c->commit.link);
-  free(c);
+  free(c->surfaces);
+  poolfree(&clientpool, c);
 }
 
 void togglefullscreen(const Arg *arg) {
@@ -474,6 +673,8 @@ void togglefullscreen(const Arg *arg) {
 }
 
 void setfullscreen(Client *c, int fullscreen) {
+  if (c->mon)
+    c->mon->nfullscreen += !!fullscreen - c->isfullscreen;
   c->isfullscreen = fullscreen;
   c->bw = (1 - fullscreen) * borderpx;
   client_set_fullscreen(c, fullscreen);
@@ -493,6 +694,7 @@ void setfullscreen(Client *c, int fullscreen) {
 }
 
 void fullscreennotify(struct wl_listener *listener, void *data) {
+  TRACE();
   Client *c = wl_container_of(listener, c, fullscreen);
   setfullscreen(c, !c->isfullscreen);
 }
@@ -509,12 +711,25 @@ Monitor *dirtomon(enum wlr_direction dir) {
   return selmon;
 }
 
+void flushmotion(void) {
+  /* Handle the motion queued since the last pointer frame, if any */
+  if (!pendingmotion)
+    return;
+  wl_event_source_remove(pendingmotion);
+  pendingmotion = NULL;
+  motionnotify(motiontime);
+}
+
 void focusclient(Client *c, int lift) {
   struct wlr_surface *old = seat->keyboard_state.focused_surface;
   struct wlr_keyboard *kb;
 
   /* Raise client in stacking order if requested */
   if (c && lift) {
+    if (stack.next != &c->slink) {
+      damageclient(c, NULL, 1);
+      hitschanged();
+    }
     wl_list_remove(&c->slink);
     wl_list_insert(&stack, &c->slink);
   }
@@ -526,9 +741,14 @@ void focusclient(Client *c, int lift) {
   if (c) {
     wl_list_remove(&c->flink);
     wl_list_insert(&fstack, &c->flink);
+    if (c->mon) {
+      wl_list_remove(&c->mflink);
+      wl_list_insert(&c->mon->fstack, &c->mflink);
+    }
     selmon = c->mon;
-    c->isurgent = 0;
+    seturgent(c, 0);
   }
+  damagefocus();
   printstatus();
 
   /* Deactivate old client if focus is changing */
@@ -580,15 +800,15 @@ void focusstack(const Arg *arg) {
   if (!sel)
     return;
   if (arg->i > 0) {
-    wl_list_for_each(c, &sel->link, link) {
-      if (&c->link == &clients)
+    wl_list_for_each(c, &sel->mlink, mlink) {
+      if (&c->mlink == &selmon->clients)
         continue; /* wrap past the sentinel node */
       if (VISIBLEON(c, selmon))
         break; /* found it */
     }
   } else {
-    wl_list_for_each_reverse(c, &sel->link, link) {
-      if (&c->link == &clients)
+    wl_list_for_each_reverse(c, &sel->mlink, mlink) {
+      if (&c->mlink == &selmon->clients)
         continue; /* wrap past the sentinel node */
       if (VISIBLEON(c, selmon))
         break; /* found it */
@@ -599,34 +819,75 @@ void focusstack(const Arg *arg) {
 }
 
 Client *focustop(Monitor *m) {
+  /* m is NULL for clients that are not mapped yet, or without monitors */
   Client *c;
-  wl_list_for_each(c, &fstack, flink) if (VISIBLEON(c, m)) return c;
+  if (!m)
+    return NULL;
+  wl_list_for_each(c, &m->fstack, mflink) if (VISIBLEON(c, m)) return c;
   return NULL;
 }
 
-void incnmaster(const Arg *arg) {
-  selmon->nmaster = MAX(selmon->nmaster + arg->i, 0);
-  arrange(selmon);
+void sendframedone(struct wlr_surface *surface, int sx, int sy, void *data) {
+  wlr_surface_send_frame_done(surface, data);
 }
 
-int keybinding(uint32_t mods, xkb_keysym_t sym) {
-  /*
-   * Here we handle compositor keybindings. This is when the compositor is
-   * processing keys, rather than passing them on to the client for its own
-   * processing.
-   */
-  int handled = 0;
-  const Key *k;
-  for (k = keys; k < END(keys); k++) {
-    if (CLEANMASK(mods) == CLEANMASK(k->mod) && sym == k->keysym && k->func) {
-      k->func(&k->arg);
-      handled = 1;
+void framedone(Monitor *m, struct timespec *now) {
+  /* Send frame done to everything shown on m without rendering it, so that
+   * clients waiting on a frame callback keep going. */
+  Client *c;
+  LayerSurface *layersurface;
+  size_t i;
+
+  for (i = 0; i < LENGTH(m->layers); i++) {
+    wl_list_for_each(layersurface, &m->layers[i], link) {
+      wlr_surface_for_each_surface(layersurface->layer_surface->surface,
+                                   sendframedone, now);
     }
   }
-  return handled;
+  wl_list_for_each(c, &stack, slink) {
+    if (VISIBLEON(c, c->mon) &&
+        framemon(c->current.width ? &c->current : &c->geom) == m)
+      clientsurfaces(c, sendframedone, now);
+  }
+#ifdef XWAYLAND
+  wl_list_for_each(c, &independents, link) {
+    if (framemon(&c->geom) == m)
+      clientsurfaces(c, sendframedone, now);
+  }
+#endif
+}
+
+Monitor *framemon(const struct wlr_box *box) {
+  /* Frame callbacks of a client are only sent for the frames of one monitor,
+   * so that a client spanning monitors is not paced by all of their refresh
+   * rates at once: the enabled one showing most of box, the fastest one if
+   * several show as much. */
+  Monitor *m, *best = NULL;
+  struct wlr_box overlap;
+  long area, bestarea = 0;
+
+  wl_list_for_each(m, &mons, link) {
+    if (!m->wlr_output->enabled ||
+        !wlr_box_intersection(&overlap, &m->m, box))
+      continue;
+    area = (long)overlap.width * overlap.height;
+    if (area > bestarea ||
+        (area == bestarea &&
+         m->wlr_output->refresh > best->wlr_output->refresh)) {
+      best = m;
+      bestarea = area;
+    }
+  }
+  return best;
+}
+
+void incnmaster(const Arg *arg) {
+  selmon->nmaster = MAX(selmon->nmaster + arg->i, 0);
+  arrange(selmon);
 }
 
 void keypress(struct wl_listener *listener, void *data) {
+  TRACE();
   int i;
   /* This event is raised when a key is pressed or released. */
   Keyboard *kb = wl_container_of(listener, kb, key);
@@ -651,7 +912,8 @@ void keypress(struct wl_listener *listener, void *data) {
 
   if (!handled) {
     /* Pass unhandled keycodes along to the client. */
-    wlr_seat_set_keyboard(seat, kb->device);
+    if (seat->keyboard_state.keyboard != kb->device->keyboard)
+      wlr_seat_set_keyboard(seat, kb->device);
     wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode,
                                  event->state);
   }
@@ -660,14 +922,17 @@ void keypress(struct wl_listener *listener, void *data) {
 void keypressmod(struct wl_listener *listener, void *data) {
   /* This event is raised when a modifier key, such as shift or alt, is
    * pressed. We simply communicate this to the client. */
+  TRACE();
   Keyboard *kb = wl_container_of(listener, kb, modifiers);
   /*
    * A seat can only have one keyboard, but this is a limitation of the
    * Wayland protocol - not wlroots. We assign all connected keyboards to the
    * same seat. You can swap out the underlying wlr_keyboard like this and
-   * wlr_seat handles this transparently.
+   * wlr_seat handles this transparently. Physical keyboards share a group,
+   * so this only happens when switching to or from a virtual keyboard.
    */
-  wlr_seat_set_keyboard(seat, kb->device);
+  if (seat->keyboard_state.keyboard != kb->device->keyboard)
+    wlr_seat_set_keyboard(seat, kb->device);
   /* Send modifiers to the client. */
   wlr_seat_keyboard_notify_modifiers(seat, &kb->device->keyboard->modifiers);
 }
@@ -680,19 +945,26 @@ void killclient(const Arg *arg) {
 }
 
 void maplayersurfacenotify(struct wl_listener *listener, void *data) {
+  TRACE();
   LayerSurface *layersurface = wl_container_of(listener, layersurface, map);
   wlr_surface_send_enter(layersurface->layer_surface->surface,
                          layersurface->layer_surface->output);
+  damagelayersurface(layersurface, NULL, 1);
+  hitschanged();
   motionnotify(0);
 }
 
 void mapnotify(struct wl_listener *listener, void *data) {
   /* Called when the surface is mapped, or ready to display on-screen. */
+  TRACE();
   Client *c = wl_container_of(listener, c, map);
 
   if (client_is_unmanaged(c)) {
     /* Insert this independent into independents lists. */
     wl_list_insert(&independents, &c->link);
+    client_get_geometry(c, &c->geom);
+    damageclient(c, NULL, 1);
+    hitschanged();
     return;
   }
 
@@ -713,16 +985,32 @@ void mapnotify(struct wl_listener *listener, void *data) {
   applyrules(c);
 }
 
+int monintersects(Monitor *m, const struct wlr_box *box) {
+  /* Like wlr_output_layout_intersects(), without walking the layout for the
+   * offset of m, which updatemons() keeps in m->m */
+  struct wlr_box overlap;
+
+  return wlr_box_intersection(&overlap, &m->m, box);
+}
+
 void monocle(Monitor *m) {
   Client *c;
 
-  wl_list_for_each(c, &clients, link) {
+  wl_list_for_each(c, &m->clients, mlink) {
     if (!VISIBLEON(c, m) || c->isfloating || c->isfullscreen)
       continue;
     resize(c, m->w.x, m->w.y, m->w.width, m->w.height, 0);
   }
 }
 
+void motionidle(void *data) {
+  /* The device sent no frame event to group its motion by */
+  TRACE();
+  pendingmotion = NULL;
+  motionnotify(motiontime);
+  wlr_seat_pointer_notify_frame(seat);
+}
+
 void motionnotify(uint32_t time) {
   double sx = 0, sy = 0;
   struct wlr_surface *surface = NULL;
@@ -733,52 +1021,24 @@ void motionnotify(uint32_t time) {
     wlr_idle_notify_activity(idle, seat);
 
     /* Update selmon (even while dragging a window) */
-    if (sloppyfocus)
+    if (sloppyfocus) {
       selmon = xytomon(cursor->x, cursor->y);
+      damagefocus();
+    }
   }
 
-  /* If we are currently grabbing the mouse, handle and return */
-  if (cursor_mode == CurMove) {
-    /* Move the grabbed client to the new position. */
-    resize(grabc, cursor->x - grabcx, cursor->y - grabcy, grabc->geom.width,
-           grabc->geom.height, 1);
-    return;
-  } else if (cursor_mode == CurResize) {
-    resize(grabc, grabc->geom.x, grabc->geom.y, cursor->x - grabc->geom.x,
-           cursor->y - grabc->geom.y, 1);
+  /* If we are currently grabbing the mouse, let the grabbed client catch up
+   * with the cursor right before the next frame is drawn; the client can't
+   * show more than one configure per frame anyway. See movegrab(). */
+  if (cursor_mode != CurNormal) {
+    grabmoved = 1;
+    wlr_output_schedule_frame(grabc->mon->wlr_output);
     return;
   }
 
-  if ((surface =
-           xytolayersurface(&selmon->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY],
-                            cursor->x, cursor->y, &sx, &sy)))
-    ;
-  else if ((surface =
-                xytolayersurface(&selmon->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP],
-                                 cursor->x, cursor->y, &sx, &sy)))
-    ;
-#ifdef XWAYLAND
-  /* Find an independent under the pointer and send the event along. */
-  else if ((c = xytoindependent(cursor->x, cursor->y))) {
-    surface = wlr_surface_surface_at(c->surface.xwayland->surface,
-                                     cursor->x - c->surface.xwayland->x - c->bw,
-                                     cursor->y - c->surface.xwayland->y - c->bw,
-                                     &sx, &sy);
-
-    /* Otherwise, find the client under the pointer and send the event along. */
-  }
-#endif
-  else if ((c = xytoclient(cursor->x, cursor->y))) {
-    surface = client_surface_at(c, cursor->x - c->geom.x - c->bw,
-                                cursor->y - c->geom.y - c->bw, &sx, &sy);
-  } else if ((surface = xytolayersurface(
-                  &selmon->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM], cursor->x,
-                  cursor->y, &sx, &sy)))
-    ;
-  else
-    surface =
-        xytolayersurface(&selmon->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND],
-                         cursor->x, cursor->y, &sx, &sy);
+  /* Find the layer surface, independent or client under the pointer and send
+   * the event along. */
+  surface = xytosurface(cursor->x, cursor->y, &c, &sx, &sy);
 
   /* If there's no client surface under the cursor, set the cursor image to a
    * default. This is what makes the cursor image appear when you move it
@@ -789,6 +1049,20 @@ void motionnotify(uint32_t time) {
   pointerfocus(c, surface, sx, sy, time);
 }
 
+void movegrab(void) {
+  if (!grabmoved)
+    return;
+  grabmoved = 0;
+  if (cursor_mode == CurMove) {
+    /* Move the grabbed client to the new position. */
+    resize(grabc, cursor->x - grabcx, cursor->y - grabcy, grabc->geom.width,
+           grabc->geom.height, 1);
+  } else if (cursor_mode == CurResize) {
+    resize(grabc, grabc->geom.x, grabc->geom.y, cursor->x - grabc->geom.x,
+           cursor->y - grabc->geom.y, 1);
+  }
+}
+
 void moveresize(const Arg *arg) {
   if (cursor_mode != CurNormal || !(grabc = xytoclient(cursor->x, cursor->y)))
     return;
@@ -895,35 +1169,31 @@ void pointerfocus(Client *c, struct wlr_surface *surface, double sx, double sy,
     focusclient(c, 0);
 }
 
-void printstatus(void) {
-  Monitor *m = NULL;
-  Client *c;
-  unsigned int occ, urg, sel;
+void presentmon(struct wl_listener *listener, void *data) {
+  /* Presentation timestamps let renderdelay() predict the next vblank */
+  TRACE();
+  Monitor *m = wl_container_of(listener, m, present);
+  struct wlr_output_event_present *event = data;
 
-  wl_list_for_each(m, &mons, link) {
-    occ = urg = 0;
-    wl_list_for_each(c, &clients, link) {
-      if (c->mon != m)
-        continue;
-      occ |= c->tags;
-      if (c->isurgent)
-        urg |= c->tags;
-    }
-    if ((c = focustop(m))) {
-      printf("%s title %s\n", m->wlr_output->name,
-             client_get_title(focustop(m)));
-      sel = c->tags;
-    } else {
-      printf("%s title \n", m->wlr_output->name);
-      sel = 0;
-    }
+  /* Only the frames showframe() committed count towards the latency, not
+   * commits made to configure the output */
+  if (event->presented && event->when && m->framepending)
+    recordtime(&m->presenthist,
+               TIMESPEC_NSEC(event->when) - TIMESPEC_NSEC(&m->committed));
+  m->framepending = 0;
+  if (!event->when)
+    return;
+  m->lastpresent = *event->when;
+  m->refresh = event->refresh;
+}
 
-    printf("%s selmon %u\n", m->wlr_output->name, m == selmon);
-    printf("%s tags %u %u %u %u\n", m->wlr_output->name, occ,
-           m->tagset[m->seltags], sel, urg);
-    printf("%s layout %s\n", m->wlr_output->name, m->lt[m->sellt]->symbol);
-  }
-  fflush(stdout);
+void queuemotion(uint32_t time) {
+  /* Pointers report motion in bursts of events followed by a frame event;
+   * hit testing is done once for the whole burst, see cursorframe(). */
+  motiontime = time;
+  if (!pendingmotion)
+    pendingmotion = wl_event_loop_add_idle(wl_display_get_event_loop(dpy),
+                                           motionidle, NULL);
 }
 
 void quit(const Arg *arg) { wl_display_terminate(dpy); }
@@ -934,10 +1204,7 @@ void render(struct wlr_surface *surface, int sx, int sy, void *data) {
   /* This function is called for every surface that needs to be rendered. */
   struct render_data *rdata = data;
   struct wlr_output *output = rdata->output;
-  double ox = 0, oy = 0;
   struct wlr_box obox;
-  float matrix[9];
-  enum wl_output_transform transform;
 
   /* We first obtain a wlr_texture, which is a GPU resource. wlroots
    * automatically handles negotiating these with the client. The underlying
@@ -948,20 +1215,39 @@ void render(struct wlr_surface *surface, int sx, int sy, void *data) {
   if (!texture)
     return;
 
-  /* The client has a position in layout coordinates. If you have two displays,
-   * one next to the other, both 1080p, a client on the rightmost display might
-   * have layout coordinates of 2000,100. We need to translate that to
-   * output-local coordinates, or (2000 - 1920). */
-  wlr_output_layout_output_coords(output_layout, output, &ox, &oy);
-
-  /* We also have to apply the scale factor for HiDPI outputs. This is only
-   * part of the puzzle, dwl does not fully support HiDPI. */
-  obox.x = ox + rdata->x + sx;
-  obox.y = oy + rdata->y + sy;
+  /* The surface tree was placed in output-local coordinates when the scene
+   * was built, see renderscene(). We also have to apply the scale factor for
+   * HiDPI outputs. This is only part of the puzzle, dwl does not fully
+   * support HiDPI. */
+  obox.x = rdata->x + sx;
+  obox.y = rdata->y + sy;
   obox.width = surface->current.width;
   obox.height = surface->current.height;
   scalebox(&obox, output->scale);
 
+  rendertexture(output, texture, &obox, surface->current.transform,
+                rdata->damage);
+
+  /* This lets the client know that we've displayed that frame and it can
+   * prepare another one now if it likes. */
+  if (rdata->framedone)
+    wlr_surface_send_frame_done(surface, rdata->when);
+}
+
+void rendertexture(struct wlr_output *output, struct wlr_texture *texture,
+                   struct wlr_box *obox, enum wl_output_transform transform,
+                   pixman_region32_t *damage) {
+  /* obox is output-local and already scaled */
+  float matrix[9];
+  pixman_region32_t tdamage;
+  pixman_box32_t *rects;
+  int i, nrects;
+
+  /* Only the parts of the texture inside the frame's damage are redrawn. */
+  pixman_region32_init_rect(&tdamage, obox->x, obox->y, obox->width,
+                            obox->height);
+  pixman_region32_intersect(&tdamage, &tdamage, damage);
+
   /*
    * Those familiar with OpenGL are also familiar with the role of matrices
    * in graphics programming. We need to prepare a matrix to render the
@@ -973,157 +1259,280 @@ void render(struct wlr_surface *surface, int sx, int sy, void *data) {
    * Naturally you can do this any way you like, for example to make a 3D
    * compositor.
    */
-  transform = wlr_output_transform_invert(surface->current.transform);
-  wlr_matrix_project_box(matrix, &obox, transform, 0, output->transform_matrix);
+  transform = wlr_output_transform_invert(transform);
+  wlr_matrix_project_box(matrix, obox, transform, 0, output->transform_matrix);
 
   /* This takes our matrix, the texture, and an alpha, and performs the actual
-   * rendering on the GPU. */
-  wlr_render_texture_with_matrix(drw, texture, matrix, 1);
-
-  /* This lets the client know that we've displayed that frame and it can
-   * prepare another one now if it likes. */
-  wlr_surface_send_frame_done(surface, rdata->when);
+   * rendering on the GPU, once for every damaged rectangle. */
+  rects = pixman_region32_rectangles(&tdamage, &nrects);
+  for (i = 0; i < nrects; i++) {
+    scissoroutput(output, &rects[i]);
+    wlr_render_texture_with_matrix(drw, texture, matrix, 1);
+  }
+  pixman_region32_fini(&tdamage);
 }
 
-void renderclients(Monitor *m, struct timespec *now) {
-  Client *c, *sel = selclient();
-  const float *color;
-  double ox, oy;
-  int i, w, h;
-  struct render_data rdata;
-  struct wlr_box *borders;
-  struct wlr_surface *surface;
-  /* Each subsequent window we render is rendered on top of the last. Because
-   * our stacking list is ordered front-to-back, we iterate over it backwards.
-   */
-  wl_list_for_each_reverse(c, &stack, slink) {
-    /* Only render visible clients which show on this monitor */
-    if (!VISIBLEON(c, c->mon) ||
-        !wlr_output_layout_intersects(output_layout, m->wlr_output, &c->geom))
+void rendersaved(Client *c, struct wlr_output *output, int x, int y,
+                 pixman_region32_t *damage) {
+  /* x and y are where the surfaces of c start, output-local */
+  SavedBuffer *saved;
+  struct wlr_box obox;
+
+  wl_list_for_each(saved, &c->saved, link) {
+    if (!saved->buffer->texture)
       continue;
+    obox.x = x + saved->x;
+    obox.y = y + saved->y;
+    obox.width = saved->width;
+    obox.height = saved->height;
+    scalebox(&obox, output->scale);
+    rendertexture(output, saved->buffer->texture, &obox, saved->transform,
+                  damage);
+  }
+}
 
-    surface = client_surface(c);
-    ox = c->geom.x, oy = c->geom.y;
-    wlr_output_layout_output_coords(output_layout, m->wlr_output, &ox, &oy);
-
-    if (c->bw) {
-      w = surface->current.width;
-      h = surface->current.height;
-      borders = (struct wlr_box[4]){
-          {ox, oy, w + 2 * c->bw, c->bw},             /* top */
-          {ox, oy + c->bw, c->bw, h},                 /* left */
-          {ox + c->bw + w, oy + c->bw, c->bw, h},     /* right */
-          {ox, oy + c->bw + h, w + 2 * c->bw, c->bw}, /* bottom */
-      };
-
-      /* Draw window borders */
-      color = (c == sel) ? focuscolor : bordercolor;
-      for (i = 0; i < 4; i++) {
-        scalebox(&borders[i], m->wlr_output->scale);
-        wlr_render_rect(drw, &borders[i], color,
-                        m->wlr_output->transform_matrix);
-      }
-    }
+void renderrect(struct wlr_output *output, struct wlr_box *box,
+                const float *color, pixman_region32_t *damage) {
+  /* box is output-local and already scaled */
+  pixman_region32_t rdamage;
+  pixman_box32_t *rects;
+  int i, nrects;
 
-    /* This calls our render function for each surface among the
-     * xdg_surface's toplevel and popups. */
-    rdata.output = m->wlr_output;
-    rdata.when = now;
-    rdata.x = c->geom.x + c->bw;
-    rdata.y = c->geom.y + c->bw;
-    client_for_each_surface(c, render, &rdata);
+  pixman_region32_init_rect(&rdamage, box->x, box->y, box->width, box->height);
+  pixman_region32_intersect(&rdamage, &rdamage, damage);
+  rects = pixman_region32_rectangles(&rdamage, &nrects);
+  for (i = 0; i < nrects; i++) {
+    scissoroutput(output, &rects[i]);
+    wlr_render_rect(drw, box, color, output->transform_matrix);
+  }
+  pixman_region32_fini(&rdamage);
+}
+
+int renderframe(Monitor *m, struct timespec *now) {
+  /* Renders the damaged part of m and commits it. Returns 1 if a frame was
+   * committed, 0 if there was nothing to commit and -1 on failure. */
+  TRACE();
+  int committed = -1;
+  int i, nrects, width, height;
+  bool needs_frame;
+  pixman_region32_t damage, frame_damage, opaque, below;
+  pixman_box32_t *rects;
+  struct timespec end;
+  int64_t elapsed;
+
+  pixman_region32_init(&damage);
+  pixman_region32_init(&frame_damage);
+
+  /* A fullscreen client may be shown without compositing at all */
+  if (scanout(m, now)) {
+    committed = 1;
+    goto finish;
   }
-}
 
-void renderlayer(struct wl_list *layer_surfaces, struct timespec *now) {
-  LayerSurface *layersurface;
-  wl_list_for_each(layersurface, layer_surfaces, link) {
-    struct render_data rdata = {
-        .output = layersurface->layer_surface->output,
-        .when = now,
-        .x = layersurface->geo.x,
-        .y = layersurface->geo.y,
-    };
-
-    wlr_surface_for_each_surface(layersurface->layer_surface->surface, render,
-                                 &rdata);
+  /* wlr_output_damage_attach_render makes the OpenGL context current and
+   * tells us which part of the buffer has to be repainted. */
+  if (!wlr_output_damage_attach_render(m->damage, &needs_frame, &damage))
+    goto finish;
+
+  if (!needs_frame) {
+    /* Nothing changed since the last frame: keep showing the old buffer and
+     * don't commit at all. */
+    wlr_output_rollback(m->wlr_output);
+    framedone(m, now);
+    committed = 0;
+    goto finish;
+  }
+
+  /* Begin the renderer (calls glViewport and some other GL sanity checks) */
+  wlr_renderer_begin(drw, m->wlr_output->width, m->wlr_output->height);
+
+  if (pixman_region32_not_empty(&damage)) {
+    /* Nothing below opaque clients can be seen, so neither the background
+     * nor the layers under the clients are drawn there. */
+    pixman_region32_init(&opaque);
+    pixman_region32_init(&below);
+    cullclients(m, &opaque);
+    pixman_region32_subtract(&below, &damage, &opaque);
+
+    rects = pixman_region32_rectangles(&below, &nrects);
+    for (i = 0; i < nrects; i++) {
+      scissoroutput(m->wlr_output, &rects[i]);
+      wlr_renderer_clear(drw, rootcolor);
+    }
+
+    renderscene(m, now, &below, &damage);
+    pixman_region32_fini(&below);
+    pixman_region32_fini(&opaque);
+  } else {
+    /* The buffer only needs to be swapped */
+    framedone(m, now);
   }
+
+  /* Hardware cursors are rendered by the GPU on a separate plane, and can be
+   * moved around without re-rendering what's beneath them - which is more
+   * efficient. However, not all hardware supports hardware cursors. For
+   * this reason, wlroots provides a software fallback, which we ask it to
+   * render here. wlr_cursor handles configuring hardware vs software cursors
+   * for you, and this function is a no-op when hardware cursors are in
+   * use. Software cursor movement damages the output by itself. */
+  wlr_renderer_scissor(drw, NULL);
+  wlr_output_render_software_cursors(m->wlr_output, &damage);
+
+  /* Conclude rendering and swap the buffers, showing the final frame
+   * on-screen. */
+  wlr_renderer_end(drw);
+
+  /* Remember how long this took for the automatic render delay. The
+   * estimate follows slower frames at once and decays slowly. */
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed = TIMESPEC_NSEC(&end) - TIMESPEC_NSEC(now);
+  m->rendertime = MAX(elapsed, m->rendertime - m->rendertime / 16);
+  recordtime(&m->renderhist, elapsed);
+
+  /* Tell the backend which part of the buffer changed, in buffer
+   * coordinates */
+  wlr_output_transformed_resolution(m->wlr_output, &width, &height);
+  wlr_region_transform(&frame_damage, &m->damage->current,
+                       wlr_output_transform_invert(m->wlr_output->transform),
+                       width, height);
+  wlr_output_set_damage(m->wlr_output, &frame_damage);
+  if (wlr_output_commit(m->wlr_output))
+    committed = 1;
+
+finish:
+  pixman_region32_fini(&frame_damage);
+  pixman_region32_fini(&damage);
+  return committed;
+}
+
+int renderdelay(Monitor *m) {
+  /* Milliseconds to wait after the frame event so that rendering finishes
+   * just before the next predicted vblank, or 0 to render right away. */
+  struct timespec now;
+  int64_t next, refresh = m->refresh;
+  int maxrender = m->maxrendertime, delay;
+
+  if (maxrender < 0)
+    /* Automatic: the slowest recent render, rounded up, plus a millisecond
+     * for the commit to reach the hardware */
+    maxrender = (m->rendertime + 999999) / 1000000 + 1;
+  if (!maxrender || refresh <= 0 || !m->lastpresent.tv_sec)
+    return 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  next = TIMESPEC_NSEC(&m->lastpresent);
+  if (next <= TIMESPEC_NSEC(&now))
+    next += ((TIMESPEC_NSEC(&now) - next) / refresh + 1) * refresh;
+  delay = (next - TIMESPEC_NSEC(&now)) / 1000000 - maxrender;
+  return delay < 1 ? 0 : delay;
 }
 
 void rendermon(struct wl_listener *listener, void *data) {
-  Client *c;
-  int render = 1;
-
   /* This function is called every time an output is ready to display a frame,
-   * generally at the output's refresh rate (e.g. 60Hz). */
+   * generally at the output's refresh rate (e.g. 60Hz), as long as something
+   * on it has been damaged since the last frame. */
+  TRACE();
   Monitor *m = wl_container_of(listener, m, frame);
+  int delay;
 
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
+  /* Whatever we committed last has been presented by now */
+  m->framepending = 0;
+  /* The delayed render of this frame is still to come */
+  if (m->repaintarmed)
+    return;
 
-  /* Do not render if any XDG clients have an outstanding resize. */
-  wl_list_for_each(c, &stack, slink) {
-    if (c->resize) {
-      wlr_surface_send_frame_done(client_surface(c), &now);
-      render = 0;
-    }
+  /* Rendering right away would make the frame a whole refresh period old by
+   * the time it is shown; start it as late as the render budget allows so
+   * that it includes the latest client commits. */
+  if ((delay = renderdelay(m))) {
+    m->repaintarmed = 1;
+    wl_event_source_timer_update(m->repaint, delay);
+    return;
   }
+  showframe(m);
+}
 
-  /* HACK: This loop is the simplest way to handle ephemeral pageflip
-   * failures but probably not the best. Revisit if damage tracking is
-   * added. */
-  do {
-    /* wlr_output_attach_render makes the OpenGL context current. */
-    if (!wlr_output_attach_render(m->wlr_output, NULL))
-      return;
-
-    if (render) {
-      /* Begin the renderer (calls glViewport and some other GL sanity checks)
-       */
-      wlr_renderer_begin(drw, m->wlr_output->width, m->wlr_output->height);
-      wlr_renderer_clear(drw, rootcolor);
+int repaintmon(void *data) {
+  TRACE();
+  Monitor *m = data;
+  m->repaintarmed = 0;
+  showframe(m);
+  return 0;
+}
 
-      renderlayer(&m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND], &now);
-      renderlayer(&m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM], &now);
-      renderclients(m, &now);
-#ifdef XWAYLAND
-      renderindependents(m->wlr_output, &now);
-#endif
-      renderlayer(&m->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP], &now);
-      renderlayer(&m->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY], &now);
-
-      /* Hardware cursors are rendered by the GPU on a separate plane, and can
-       * be moved around without re-rendering what's beneath them - which is
-       * more efficient. However, not all hardware supports hardware cursors.
-       * For this reason, wlroots provides a software fallback, which we ask it
-       * to render here. wlr_cursor handles configuring hardware vs software
-       * cursors for you,
-       * and this function is a no-op when hardware cursors are in use. */
-      wlr_output_render_software_cursors(m->wlr_output, NULL);
-
-      /* Conclude rendering and swap the buffers, showing the final frame
-       * on-screen. */
-      wlr_renderer_end(drw);
-    }
+void showframe(Monitor *m) {
+  struct timespec now;
+
+  /* Interactive moves and resizes are applied once per frame */
+  movegrab();
 
-  } while (!wlr_output_commit(m->wlr_output));
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  switch (renderframe(m, &now)) {
+  case 1:
+    m->framepending = 1;
+    clock_gettime(CLOCK_MONOTONIC, &m->committed);
+    if (m->txn)
+      m->stalled++;
+    /* fallthrough */
+  case 0:
+    m->frameneeded = 0;
+    if (m->retrydelay) {
+      m->retrydelay = 0;
+      wl_event_source_timer_update(m->retry, 0);
+    }
+    break;
+  default:
+    /* Pageflips may fail transiently, e.g. while a dock renegotiates its
+     * links. Rather than spinning on the output, keep the damage and try
+     * again later, backing off while the failures persist. */
+    m->frameneeded = 1;
+    m->commitfails++;
+    if (m->retrydelay < frameretrymax &&
+        (m->retrydelay = m->retrydelay ? m->retrydelay * 2 : 1) >=
+            frameretrymax) {
+      m->retrydelay = frameretrymax;
+      wlr_log(WLR_ERROR, "%s: %u failed commits, retrying every %d ms",
+              m->wlr_output->name, m->commitfails, m->retrydelay);
+    }
+    wl_event_source_timer_update(m->retry, m->retrydelay);
+    break;
+  }
 }
 
 void resize(Client *c, int x, int y, int w, int h, int interact) {
-  /*
-   * Note that I took some shortcuts here. In a more fleshed-out
-   * compositor, you'd wait for the client to prepare a buffer at
-   * the new size, then commit any movement that was prepared.
-   */
+  /* The new geometry is shown once the client has drawn a buffer of the new
+   * size, together with everything else arranged on its monitor. Interactive
+   * moves and resizes are shown right away so that they follow the cursor. */
   struct wlr_box *bbox = interact ? &sgeom : &c->mon->w;
+  uint32_t serial;
   c->geom.x = x;
   c->geom.y = y;
   c->geom.width = w;
   c->geom.height = h;
   applybounds(c, bbox);
+  hitschanged();
   /* wlroots makes this a no-op if size hasn't changed */
-  c->resize =
+  serial =
       client_set_size(c, c->geom.width - 2 * c->bw, c->geom.height - 2 * c->bw);
+  /* Latency is counted from the first configure the client has yet to ack */
+  if (serial && !c->resize)
+    clock_gettime(CLOCK_MONOTONIC, &c->configured);
+  c->resize = serial;
+  if (interact)
+    applygeom(c);
+  else
+    txnopen(c->mon);
+}
+
+int retryframe(void *data) {
+  /* Ask for another frame event; the damage of the failed frame is still
+   * pending, so it will be redrawn. */
+  TRACE();
+  Monitor *m = data;
+  /* Nothing is left to redraw if a frame went through in the meantime */
+  if (m->frameneeded)
+    wlr_output_schedule_frame(m->wlr_output);
+  return 0;
 }
 
 void run(char *startup_cmd) {
@@ -1134,6 +1543,7 @@ void run(char *startup_cmd) {
   if (!socket)
     BARF("startup: display_add_socket_auto");
   setenv("WAYLAND_DISPLAY", socket, 1);
+  setupipc(socket);
 
   /* Now that the socket exists, run the startup command */
   if (startup_cmd) {
@@ -1143,6 +1553,7 @@ void run(char *startup_cmd) {
     if (startup_pid < 0)
       EBARF("startup: fork");
     if (startup_pid == 0) {
+      unblocksignals();
       dup2(piperw[0], STDIN_FILENO);
       close(piperw[1]);
       execl("/bin/sh", "/bin/sh", "-c", startup_cmd, NULL);
@@ -1150,6 +1561,8 @@ void run(char *startup_cmd) {
     }
     dup2(piperw[1], STDOUT_FILENO);
     close(piperw[0]);
+    /* A status bar that stops reading must not stall the compositor */
+    fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
   }
   /* If nobody is reading the status output, don't terminate */
   signal(SIGPIPE, SIG_IGN);
@@ -1190,6 +1603,101 @@ void scalebox(struct wlr_box *box, float scale) {
   box->y = ROUND(box->y * scale);
 }
 
+void scissoroutput(struct wlr_output *output, pixman_box32_t *rect) {
+  /* Damage is tracked in output-local coordinates, but the scissor box must
+   * be given in buffer coordinates */
+  struct wlr_box box = {
+      .x = rect->x1,
+      .y = rect->y1,
+      .width = rect->x2 - rect->x1,
+      .height = rect->y2 - rect->y1,
+  };
+  int width, height;
+
+  wlr_output_transformed_resolution(output, &width, &height);
+  wlr_box_transform(&box, &box, wlr_output_transform_invert(output->transform),
+                    width, height);
+  wlr_renderer_scissor(drw, &box);
+}
+
+static void countsurface(struct wlr_surface *surface, int sx, int sy,
+                         void *data) {
+  (*(int *)data)++;
+}
+
+int scanout(Monitor *m, struct timespec *now) {
+  /* Attach the buffer of a fullscreen client directly to the primary plane
+   * when it is the only thing visible on m and the output can show it as
+   * is. Returns 1 if such a frame was committed. */
+  Client *c, *independent;
+  LayerSurface *layersurface;
+  struct wlr_surface *surface;
+  struct wlr_output_cursor *oc;
+  struct wlr_output *output = m->wlr_output;
+  int i, ok = 0, nsurfaces = 0;
+
+  /* The topmost client shown on m must be a fullscreen client of m */
+  wl_list_for_each(c, &stack, slink) {
+    if (VISIBLEON(c, c->mon) && c->current.width &&
+        monintersects(m, &c->current))
+      break;
+  }
+  if (&c->slink == &stack || c->mon != m || !c->isfullscreen ||
+      memcmp(&c->current, &m->m, sizeof(c->current)) ||
+      !wl_list_empty(&c->saved))
+    goto done;
+
+  /* with nothing drawn above it */
+  for (i = ZWLR_LAYER_SHELL_V1_LAYER_TOP;
+       i <= ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY; i++) {
+    wl_list_for_each(layersurface, &m->layers[i], link) {
+      if (layersurface->layer_surface->mapped)
+        goto done;
+    }
+  }
+#ifdef XWAYLAND
+  wl_list_for_each(independent, &independents, link) {
+    if (monintersects(m, &independent->geom))
+      goto done;
+  }
+#endif
+  wl_list_for_each(oc, &output->cursors, link) {
+    if (oc->enabled && oc->visible && oc != output->hardware_cursor)
+      goto done;
+  }
+
+  /* and a single buffer that fits the output exactly */
+  clientsurfaces(c, countsurface, &nsurfaces);
+  surface = client_surface(c);
+  if (nsurfaces != 1 || !surface->buffer ||
+      surface->current.viewport.has_src || surface->current.viewport.has_dst ||
+      (float)surface->current.scale != output->scale ||
+      surface->current.transform != output->transform ||
+      surface->current.buffer_width != output->width ||
+      surface->current.buffer_height != output->height)
+    goto done;
+
+  if (!wlr_output_attach_buffer(output, &surface->buffer->base) ||
+      !wlr_output_test(output)) {
+    wlr_output_rollback(output);
+    goto done;
+  }
+  ok = wlr_output_commit(output);
+
+done:
+  if (ok != m->scanout) {
+    wlr_log(WLR_INFO, "%s: direct scanout %s", output->name,
+            ok ? "enabled" : "disabled");
+    /* Our own buffers are stale once we composite again */
+    if (!ok)
+      damagemon(m);
+    m->scanout = ok;
+  }
+  if (ok)
+    framedone(m, now);
+  return ok;
+}
+
 Client *selclient(void) {
   Client *c = wl_container_of(fstack.next, c, flink);
   if (wl_list_empty(&fstack) || !VISIBLEON(c, selmon))
@@ -1230,6 +1738,10 @@ void setmon(Client *c, Monitor *m, unsigned int newtags) {
 
   if (oldmon == m)
     return;
+  /* The new monitor suspends c again if it is hidden there */
+  suspendclient(c, 0);
+  if (oldmon)
+    detachclient(c);
   c->mon = m;
 
   /* TODO leave/enter is not optimal but works */
@@ -1244,11 +1756,28 @@ void setmon(Client *c, Monitor *m, unsigned int newtags) {
     c->tags = newtags
                   ? newtags
                   : m->tagset[m->seltags]; /* assign tags of target monitor */
+    attachclient(c);
     arrange(m);
   }
   focusclient(focustop(selmon), 1);
 }
 
+void settags(Client *c, unsigned int tags) {
+  if (c->mon)
+    counttags(c->mon, c, -1);
+  c->tags = tags;
+  if (c->mon)
+    counttags(c->mon, c, 1);
+}
+
+void seturgent(Client *c, int urgent) {
+  if (c->mon)
+    counttags(c->mon, c, -1);
+  c->isurgent = urgent;
+  if (c->mon)
+    counttags(c->mon, c, 1);
+}
+
 void sigchld(int unused) {
   /* We should be able to remove this function in favor of a simple
    *     signal(SIGCHLD, SIG_IGN);
@@ -1263,6 +1792,7 @@ void sigchld(int unused) {
 
 void spawn(const Arg *arg) {
   if (fork() == 0) {
+    unblocksignals();
     dup2(STDERR_FILENO, STDOUT_FILENO);
     setsid();
     execvp(((char **)arg->v)[0], (char **)arg->v);
@@ -1273,7 +1803,7 @@ void spawn(const Arg *arg) {
 void tag(const Arg *arg) {
   Client *sel = selclient();
   if (sel && arg->ui & TAGMASK) {
-    sel->tags = arg->ui & TAGMASK;
+    settags(sel, arg->ui & TAGMASK);
     focusclient(focustop(selmon), 1);
     arrange(selmon);
   }
@@ -1294,7 +1824,7 @@ void toggletag(const Arg *arg) {
     return;
   newtags = sel->tags ^ (arg->ui & TAGMASK);
   if (newtags) {
-    sel->tags = newtags;
+    settags(sel, newtags);
     focusclient(focustop(selmon), 1);
     arrange(selmon);
   }
@@ -1313,7 +1843,18 @@ void toggleview(const Arg *arg) {
   printstatus();
 }
 
+void unblocksignals(void) {
+  /* The event loop blocks the signals it reads, see setupstats(); children
+   * would inherit that through exec */
+  sigset_t set;
+
+  sigemptyset(&set);
+  sigprocmask(SIG_SETMASK, &set, NULL);
+}
+
 void unmaplayersurface(LayerSurface *layersurface) {
+  damagelayersurface(layersurface, NULL, 1);
+  hitschanged();
   layersurface->layer_surface->mapped = 0;
   if (layersurface->layer_surface->surface ==
       seat->keyboard_state.focused_surface)
@@ -1322,13 +1863,21 @@ void unmaplayersurface(LayerSurface *layersurface) {
 }
 
 void unmaplayersurfacenotify(struct wl_listener *listener, void *data) {
+  TRACE();
   LayerSurface *layersurface = wl_container_of(listener, layersurface, unmap);
   unmaplayersurface(layersurface);
 }
 
 void unmapnotify(struct wl_listener *listener, void *data) {
   /* Called when the surface is unmapped, and should no longer be shown. */
+  TRACE();
   Client *c = wl_container_of(listener, c, unmap);
+  damageclient(c, NULL, 1);
+  hitschanged();
+  dropbuffers(c);
+  c->resize = 0;
+  /* A remapped client is not shown before it has been arranged */
+  c->current = (struct wlr_box){0};
   wl_list_remove(&c->link);
   if (client_is_unmanaged(c))
     return;
@@ -1338,10 +1887,18 @@ void unmapnotify(struct wl_listener *listener, void *data) {
   wl_list_remove(&c->slink);
 }
 
+void updateappid(struct wl_listener *listener, void *data) {
+  TRACE();
+  Client *c = wl_container_of(listener, c, set_app_id);
+  reapplyrules(c, 0);
+}
+
 void updatetitle(struct wl_listener *listener, void *data) {
+  TRACE();
   Client *c = wl_container_of(listener, c, set_title);
   if (c == focustop(c->mon))
     printstatus();
+  reapplyrules(c, 1);
 }
 
 void view(const Arg *arg) {
@@ -1365,22 +1922,6 @@ Client *xytoclient(double x, double y) {
   return NULL;
 }
 
-struct wlr_surface *xytolayersurface(struct wl_list *layer_surfaces, double x,
-                                     double y, double *sx, double *sy) {
-  LayerSurface *layersurface;
-  wl_list_for_each_reverse(layersurface, layer_surfaces, link) {
-    struct wlr_surface *sub;
-    if (!layersurface->layer_surface->mapped)
-      continue;
-    sub = wlr_layer_surface_v1_surface_at(layersurface->layer_surface,
-                                          x - layersurface->geo.x,
-                                          y - layersurface->geo.y, sx, sy);
-    if (sub)
-      return sub;
-  }
-  return NULL;
-}
-
 Monitor *xytomon(double x, double y) {
   struct wlr_output *o = wlr_output_layout_output_at(output_layout, x, y);
   return o ? o->data : NULL;
@@ -1394,23 +1935,23 @@ void zoom(const Arg *arg) {
 
   /* Search for the first tiled window that is not sel, marking sel as
    * NULL if we pass it along the way */
-  wl_list_for_each(c, &clients,
-                   link) if (VISIBLEON(c, selmon) && !c->isfloating) {
+  wl_list_for_each(c, &selmon->clients,
+                   mlink) if (VISIBLEON(c, selmon) && !c->isfloating) {
     if (c != sel)
       break;
     sel = NULL;
   }
 
   /* Return if no other tiled window was found */
-  if (&c->link == &clients)
+  if (&c->mlink == &selmon->clients)
     return;
 
   /* If we passed sel, move c to the front; otherwise, move sel to the
    * front */
   if (!sel)
     sel = c;
-  wl_list_remove(&sel->link);
-  wl_list_insert(&clients, &sel->link);
+  wl_list_remove(&sel->mlink);
+  wl_list_insert(&selmon->clients, &sel->mlink);
 
   focusclient(sel, 1);
   arrange(selmon);
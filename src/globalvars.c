@@ -10,7 +10,7 @@ struct wlr_compositor *compositor;
 
 struct wlr_xdg_shell *xdg_shell;
 struct wlr_xdg_activation_v1 *activation;
-struct wl_list clients; /* tiling order */
+struct wl_list clients; /* all managed clients */
 struct wl_list fstack;  /* focus order */
 struct wl_list stack;   /* stacking z-order */
 struct wl_list independents;
@@ -31,11 +31,25 @@ struct wl_list keyboards;
 unsigned int cursor_mode;
 Client *grabc;
 int grabcx, grabcy; /* client-relative */
+int grabmoved;      /* grabc follows the cursor on the next frame */
+struct wl_event_source *pendingmotion; /* see flushmotion() */
+uint32_t motiontime;
 
 struct wlr_output_layout *output_layout;
 struct wlr_box sgeom;
 struct wl_list mons;
 Monitor *selmon;
+struct wl_event_source *pendingarrange; /* see arrangemons() */
+struct wl_event_source *pendingstatus;  /* see flushstatus() */
+
+/* object pools, see pool.c */
+Pool *pools;
+Pool clientpool = {.name = "Client", .size = sizeof(Client)};
+Pool keyboardpool = {.name = "Keyboard", .size = sizeof(Keyboard)};
+Pool layerpool = {.name = "LayerSurface", .size = sizeof(LayerSurface)};
+Pool monpool = {.name = "Monitor", .size = sizeof(Monitor)};
+Pool rolepool = {.name = "SurfaceRole", .size = sizeof(SurfaceRole)};
+Pool surfacepool = {.name = "SurfaceDamage", .size = sizeof(SurfaceDamage)};
 
 /* global event handlers */
 struct wl_listener cursor_axis = {.notify = axisnotify};
@@ -47,6 +61,7 @@ struct wl_listener layout_change = {.notify = updatemons};
 struct wl_listener new_input = {.notify = inputdevice};
 struct wl_listener new_virtual_keyboard = {.notify = virtualkeyboard};
 struct wl_listener new_output = {.notify = createmon};
+struct wl_listener new_surface = {.notify = createsurface};
 struct wl_listener new_xdg_surface = {.notify = createnotify};
 struct wl_listener new_layer_shell_surface = {.notify = createlayersurface};
 struct wl_listener output_mgr_apply = {.notify = outputmgrapply};
@@ -0,0 +1,178 @@
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "client.h"
+
+/*
+ * Pointer hit testing runs on every motion event, so each monitor keeps the
+ * boxes the pointer can hit on it in an array, topmost first, in the order
+ * motionnotify() has always searched them: overlay and top layer surfaces,
+ * independents, clients, bottom and background layer surfaces. The array is
+ * rebuilt on the next motion after anything it covers moved, changed its
+ * stacking or was shown or hidden, see hitschanged().
+ */
+
+/* Bumped on every change; monitors with an older copy rebuild their index */
+static unsigned int hitgen = 1;
+
+static void extendbox(struct wlr_surface *surface, int sx, int sy,
+                      void *data) {
+  struct wlr_box *box = data, sbox = {sx, sy, surface->current.width,
+                                      surface->current.height};
+  int x1 = MIN(box->x, sbox.x), y1 = MIN(box->y, sbox.y);
+
+  if (wlr_box_empty(&sbox))
+    return;
+  if (wlr_box_empty(box)) {
+    *box = sbox;
+    return;
+  }
+  box->width = MAX(box->x + box->width, sbox.x + sbox.width) - x1;
+  box->height = MAX(box->y + box->height, sbox.y + sbox.height) - y1;
+  box->x = x1;
+  box->y = y1;
+}
+
+static HitBox *addhit(Monitor *m) {
+  if (m->nhits == m->maxhits) {
+    m->maxhits = m->maxhits ? m->maxhits * 2 : 16;
+    m->hits = realloc(m->hits, m->maxhits * sizeof(*m->hits));
+  }
+  return memset(&m->hits[m->nhits++], 0, sizeof(*m->hits));
+}
+
+static void addlayer(Monitor *m, struct wl_list *layer_surfaces) {
+  LayerSurface *layersurface;
+  HitBox *hit;
+  struct wlr_box box;
+
+  wl_list_for_each_reverse(layersurface, layer_surfaces, link) {
+    if (!layersurface->layer_surface->mapped)
+      continue;
+    /* Popups may reach outside of the layer surface */
+    box = (struct wlr_box){0};
+    wlr_layer_surface_v1_for_each_surface(layersurface->layer_surface,
+                                          extendbox, &box);
+    box.x += layersurface->geo.x;
+    box.y += layersurface->geo.y;
+    if (wlr_box_empty(&box))
+      continue;
+    hit = addhit(m);
+    hit->box = box;
+    hit->layersurface = layersurface;
+  }
+}
+
+void buildhits(Monitor *m) {
+  Client *c;
+  HitBox *hit;
+  struct wlr_box overlap;
+  int i, j;
+
+  m->nhits = 0;
+  m->lasthit = -1;
+  m->hitgen = hitgen;
+
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+#ifdef XWAYLAND
+  /* Independents are only shown on the current tag, as X11 unmaps them
+   * along with the client that owns them */
+  wl_list_for_each_reverse(c, &independents, link) {
+    struct wlr_box box = {c->surface.xwayland->x, c->surface.xwayland->y,
+                          c->surface.xwayland->width,
+                          c->surface.xwayland->height};
+    if (!wlr_box_intersection(&overlap, &box, &m->m))
+      continue;
+    hit = addhit(m);
+    hit->box = box;
+    hit->c = c;
+  }
+#endif
+  wl_list_for_each(c, &stack, slink) {
+    if (!VISIBLEON(c, c->mon) || !monintersects(m, &c->geom))
+      continue;
+    hit = addhit(m);
+    hit->box = c->geom;
+    hit->c = c;
+  }
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+
+  /* An uncovered box can be hit again without looking at those above it */
+  for (i = 0; i < m->nhits; i++) {
+    for (j = 0; j < i; j++) {
+      if (wlr_box_intersection(&overlap, &m->hits[i].box, &m->hits[j].box)) {
+        m->hits[i].covered = 1;
+        break;
+      }
+    }
+  }
+}
+
+void hitschanged(void) {
+  /* Whatever the pointer can hit is drawn too */
+  hitgen++;
+  scenechanged();
+}
+
+static struct wlr_surface *hitsurface(HitBox *hit, double x, double y,
+                                      Client **pc, double *sx, double *sy) {
+  /* Returns the surface of hit at (x, y); *pc is set when the client or
+   * independent takes the pointer even without a surface there. */
+  Client *c = hit->c;
+  LayerSurface *layersurface = hit->layersurface;
+
+  if (layersurface)
+    return wlr_layer_surface_v1_surface_at(layersurface->layer_surface,
+                                           x - layersurface->geo.x,
+                                           y - layersurface->geo.y, sx, sy);
+  *pc = c;
+#ifdef XWAYLAND
+  if (client_is_unmanaged(c))
+    return wlr_surface_surface_at(c->surface.xwayland->surface,
+                                  x - c->surface.xwayland->x - c->bw,
+                                  y - c->surface.xwayland->y - c->bw, sx, sy);
+#endif
+  return clientsurfaceat(c, x - c->geom.x - c->bw, y - c->geom.y - c->bw, sx,
+                         sy);
+}
+
+struct wlr_surface *xytosurface(double x, double y, Client **pc, double *sx,
+                                double *sy) {
+  /* Find the topmost surface at (x, y), with the client it belongs to */
+  Monitor *m = xytomon(x, y);
+  struct wlr_surface *surface;
+  HitBox *hit;
+  int i;
+
+  *pc = NULL;
+  if (!m)
+    return NULL;
+  if (m->hitgen != hitgen)
+    buildhits(m);
+
+  /* Nothing above the box hit last time can have moved into the way */
+  if (m->lasthit >= 0) {
+    hit = &m->hits[m->lasthit];
+    if (!hit->covered && wlr_box_contains_point(&hit->box, x, y) &&
+        ((surface = hitsurface(hit, x, y, pc, sx, sy)) || *pc))
+      return surface;
+  }
+
+  for (i = 0; i < m->nhits; i++) {
+    hit = &m->hits[i];
+    if (!wlr_box_contains_point(&hit->box, x, y))
+      continue;
+    if ((surface = hitsurface(hit, x, y, pc, sx, sy)) || *pc) {
+      m->lasthit = i;
+      return surface;
+    }
+  }
+  m->lasthit = -1;
+  return NULL;
+}
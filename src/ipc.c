@@ -0,0 +1,424 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+/*
+ * The IPC socket lives at $XDG_RUNTIME_DIR/dwl-$WAYLAND_DISPLAY.sock, which
+ * is exported to children as DWL_SOCK. Messages in both directions are a
+ * 32-bit length in host byte order followed by that many bytes of text.
+ *
+ * Clients send commands:
+ *   subscribe CLASS...    monitor, title, focus, tags or layout; the current
+ *                         state of those classes is sent right away
+ *   unsubscribe CLASS...
+ *   pools                 "pool NAME live N free N slabs N allocs N" for
+ *                         each object pool, see pool.c
+ *   stats                 "stats MON KIND count N avg N p50 N p90 N p99 N
+ *                         max N" in us for render, present and ack, and
+ *                         "stats MON stalled N expired N failed N scanout
+ *                         0|1" for each monitor, and "stats MON client ack
+ *                         last N max N APPID" for each client on it that
+ *                         acked a resize; the ack histogram merges all the
+ *                         clients of a monitor, see stats.c
+ *   trace start|stop      record the time spent in each event handler
+ *   trace write PATH      save the recorded events as a Chrome trace, see
+ *                         trace.c
+ *   ACTION [ARG]          view, toggleview, tag, toggletag (tag masks),
+ *                         setlayout (index in layouts[]), setmfact,
+ *                         incnmaster, focusstack, focusmon, tagmon, zoom,
+ *                         togglefloating, togglefullscreen, killclient,
+ *                         chvt, quit, spawn (the rest of the line is run by
+ *                         /bin/sh)
+ * and get "ok" or "error REASON" back for each. Subscribed clients get one
+ * message per change: "monitor MON add|remove", "title MON TITLE",
+ * "focus MON 0|1", "tags MON OCC TAGS SEL URG" and "layout MON SYMBOL", the
+ * same as the status lines on stdout. Each change is formatted once and
+ * queued to every subscriber; a client that lets IPCOUTMAX bytes pile up is
+ * disconnected.
+ */
+
+#define IPCOUTMAX (64 * 1024)
+
+enum { ArgNone, ArgInt, ArgUint, ArgFloat, ArgLayout, ArgCmd };
+
+static const struct {
+  const char *name;
+  void (*func)(const Arg *);
+  int arg;
+} actions[] = {
+    {"chvt", chvt, ArgUint},
+    {"focusmon", focusmon, ArgInt},
+    {"focusstack", focusstack, ArgInt},
+    {"incnmaster", incnmaster, ArgInt},
+    {"killclient", killclient, ArgNone},
+    {"quit", quit, ArgNone},
+    {"setlayout", setlayout, ArgLayout},
+    {"setmfact", setmfact, ArgFloat},
+    {"spawn", spawn, ArgCmd},
+    {"tag", tag, ArgUint},
+    {"tagmon", tagmon, ArgInt},
+    {"togglefloating", togglefloating, ArgNone},
+    {"togglefullscreen", togglefullscreen, ArgNone},
+    {"toggletag", toggletag, ArgUint},
+    {"toggleview", toggleview, ArgUint},
+    {"view", view, ArgUint},
+    {"zoom", zoom, ArgNone},
+};
+
+static const char *classes[] = {
+    [StatusMonitor] = "monitor", [StatusTitle] = "title",
+    [StatusFocus] = "focus",     [StatusTags] = "tags",
+    [StatusLayout] = "layout",
+};
+
+static struct wl_list ipcclients; /* IpcClient::link */
+static struct wl_event_source *ipcsource;
+static int ipcfd = -1;
+static char ipcpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static void ipcclose(IpcClient *ic) {
+  wl_list_remove(&ic->link);
+  wl_event_source_remove(ic->source);
+  close(ic->fd);
+  free(ic->out);
+  free(ic);
+}
+
+static void ipckill(IpcClient *ic) {
+  /* The hangup this causes is handled by ipcread(), so that ic can be
+   * given up on from anywhere without freeing it under its caller. */
+  ic->dead = 1;
+  ic->outlen = 0;
+  shutdown(ic->fd, SHUT_RDWR);
+}
+
+static void ipcflush(IpcClient *ic) {
+  ssize_t n;
+  size_t done = 0;
+
+  while (done < ic->outlen) {
+    n = write(ic->fd, ic->out + done, ic->outlen - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (n < 0) {
+      ipckill(ic);
+      return;
+    }
+    done += n;
+  }
+  memmove(ic->out, ic->out + done, ic->outlen - done);
+  ic->outlen -= done;
+  wl_event_source_fd_update(ic->source,
+                            WL_EVENT_READABLE |
+                                (ic->outlen ? WL_EVENT_WRITABLE : 0));
+}
+
+static void ipcqueue(IpcClient *ic, const char *msg, uint32_t len) {
+  if (ic->dead)
+    return;
+  if (ic->outlen + sizeof(len) + len > IPCOUTMAX) {
+    wlr_log(WLR_INFO, "IPC client is not reading, disconnecting it");
+    ipckill(ic);
+    return;
+  }
+  if (ic->outlen + sizeof(len) + len > ic->outsize) {
+    ic->outsize = MIN(MAX(ic->outsize * 2, IPCMSGSIZE), IPCOUTMAX);
+    ic->out = realloc(ic->out, ic->outsize);
+  }
+  memcpy(ic->out + ic->outlen, &len, sizeof(len));
+  memcpy(ic->out + ic->outlen + sizeof(len), msg, len);
+  ic->outlen += sizeof(len) + len;
+  /* Messages queued behind a full socket wait for it to become writable */
+  if (ic->outlen == sizeof(len) + len)
+    ipcflush(ic);
+}
+
+static void ipcemit(IpcClient *to, int class, const char *fmt, ...) {
+  /* Send a message to the subscribers of class, or only to to */
+  IpcClient *ic;
+  char msg[IPCMSGSIZE];
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  len = MIN(len, (int)sizeof(msg) - 1);
+
+  if (to) {
+    ipcqueue(to, msg, len);
+    return;
+  }
+  wl_list_for_each(ic, &ipcclients, link) {
+    if (ic->events & 1 << class)
+      ipcqueue(ic, msg, len);
+  }
+}
+
+static void emitline(const char *line, void *data) {
+  ipcemit(data, 0, "%s", line);
+}
+
+static void sendstatus(IpcClient *to, Monitor *m, const Status *st,
+                       unsigned int changed) {
+  const char *name = m->wlr_output->name;
+
+  if (to)
+    changed &= to->events;
+  if (changed & 1 << StatusMonitor)
+    ipcemit(to, StatusMonitor, "monitor %s add", name);
+  if (changed & 1 << StatusTitle)
+    ipcemit(to, StatusTitle, "title %s %s", name, st->title);
+  if (changed & 1 << StatusFocus)
+    ipcemit(to, StatusFocus, "focus %s %u", name, st->selmon);
+  if (changed & 1 << StatusTags)
+    ipcemit(to, StatusTags, "tags %s %u %u %u %u", name, st->occ, st->tags,
+            st->sel, st->urg);
+  if (changed & 1 << StatusLayout)
+    ipcemit(to, StatusLayout, "layout %s %s", name, st->layout);
+}
+
+static unsigned int parseclasses(char *args) {
+  unsigned int events = 0;
+  char *word, *save;
+  size_t i;
+
+  for (word = strtok_r(args, " ", &save); word;
+       word = strtok_r(NULL, " ", &save)) {
+    for (i = 0; i < LENGTH(classes); i++) {
+      if (!strcmp(word, classes[i]))
+        break;
+    }
+    if (i == LENGTH(classes))
+      return 0;
+    events |= 1 << i;
+  }
+  return events;
+}
+
+static const char *ipcrun(IpcClient *ic, char *msg) {
+  /* Run one command; returns an error, or NULL */
+  char *cmd = msg, *args, *end;
+  char *argv[] = {"/bin/sh", "-c", NULL, NULL};
+  unsigned int events;
+  Monitor *m;
+  Pool *p;
+  Arg arg = {0};
+  size_t i;
+
+  cmd += strspn(cmd, " ");
+  args = cmd + strcspn(cmd, " ");
+  if (*args)
+    *args++ = '\0';
+  args += strspn(args, " ");
+
+  if (!strcmp(cmd, "pools")) {
+    for (p = pools; p; p = p->next)
+      ipcemit(ic, 0, "pool %s live %zu free %zu slabs %zu allocs %lu",
+              p->name, p->live, p->nfree, p->nslabs, p->allocs);
+    return NULL;
+  }
+  if (!strcmp(cmd, "stats")) {
+    formatstats(emitline, ic);
+    return NULL;
+  }
+  if (!strcmp(cmd, "trace")) {
+    if (!strcmp(args, "start"))
+      return tracestart() ? "out of memory" : NULL;
+    if (!strcmp(args, "stop")) {
+      tracestop();
+      return NULL;
+    }
+    if (!strncmp(args, "write ", 6))
+      return tracewrite(args + 6 + strspn(args + 6, " ")) ? strerror(errno)
+                                                          : NULL;
+    return "bad argument";
+  }
+  if (!strcmp(cmd, "subscribe") || !strcmp(cmd, "unsubscribe")) {
+    if (!(events = parseclasses(args)))
+      return "unknown event class";
+    if (*cmd == 'u') {
+      ic->events &= ~events;
+      return NULL;
+    }
+    events &= ~ic->events;
+    ic->events |= events;
+    wl_list_for_each(m, &mons, link) {
+      if (m->ipcstatus.valid)
+        sendstatus(ic, m, &m->ipcstatus, events);
+    }
+    return NULL;
+  }
+
+  for (i = 0; i < LENGTH(actions); i++) {
+    if (!strcmp(cmd, actions[i].name))
+      break;
+  }
+  if (i == LENGTH(actions))
+    return "unknown command";
+
+  errno = 0;
+  end = args;
+  switch (actions[i].arg) {
+  case ArgInt:
+    arg.i = strtol(args, &end, 0);
+    break;
+  case ArgUint:
+    arg.ui = strtoul(args, &end, 0);
+    break;
+  case ArgFloat:
+    arg.f = strtof(args, &end);
+    break;
+  case ArgLayout:
+    if (*args) {
+      arg.ui = strtoul(args, &end, 0);
+      if (arg.ui >= LENGTH(layouts))
+        return "no such layout";
+      arg.v = &layouts[arg.ui];
+    }
+    break;
+  case ArgCmd:
+    if (!*args)
+      return "missing command";
+    argv[2] = args;
+    arg.v = argv;
+    end = args + strlen(args);
+    break;
+  }
+  /* Numbers are required and taken whole; other actions take nothing */
+  if (errno || *end ||
+      (end == args && actions[i].arg != ArgNone &&
+       actions[i].arg != ArgLayout))
+    return "bad argument";
+  if (!selmon)
+    return "no monitor";
+  actions[i].func(&arg);
+  return NULL;
+}
+
+static int ipcread(int fd, uint32_t mask, void *data) {
+  TRACE();
+  IpcClient *ic = data;
+  char msg[IPCMSGSIZE + 1];
+  const char *err;
+  uint32_t len;
+  ssize_t n;
+
+  if (mask & WL_EVENT_WRITABLE)
+    ipcflush(ic);
+  if (!ic->dead && mask & WL_EVENT_READABLE) {
+    n = read(fd, ic->in + ic->inlen, sizeof(ic->in) - ic->inlen);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+      ipckill(ic);
+    else if (n > 0)
+      ic->inlen += n;
+  }
+
+  while (!ic->dead && ic->inlen >= sizeof(len)) {
+    memcpy(&len, ic->in, sizeof(len));
+    if (len > IPCMSGSIZE) {
+      ipckill(ic);
+      break;
+    }
+    if (ic->inlen < sizeof(len) + len)
+      break;
+    memcpy(msg, ic->in + sizeof(len), len);
+    msg[len] = '\0';
+    ic->inlen -= sizeof(len) + len;
+    memmove(ic->in, ic->in + sizeof(len) + len, ic->inlen);
+    if ((err = ipcrun(ic, msg)))
+      ipcemit(ic, 0, "error %s", err);
+    else
+      ipcemit(ic, 0, "ok");
+  }
+
+  if (ic->dead || mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+    ipcclose(ic);
+  return 0;
+}
+
+static int ipcaccept(int fd, uint32_t mask, void *data) {
+  TRACE();
+  IpcClient *ic;
+  int cfd;
+
+  if ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0)
+    return 0;
+  ic = calloc(1, sizeof(*ic));
+  ic->fd = cfd;
+  ic->source = wl_event_loop_add_fd(wl_display_get_event_loop(dpy), cfd,
+                                    WL_EVENT_READABLE, ipcread, ic);
+  wl_list_insert(&ipcclients, &ic->link);
+  return 0;
+}
+
+void cleanupipc(void) {
+  IpcClient *ic, *tmp;
+
+  if (ipcfd < 0)
+    return;
+  wl_list_for_each_safe(ic, tmp, &ipcclients, link)
+    ipcclose(ic);
+  wl_event_source_remove(ipcsource);
+  close(ipcfd);
+  unlink(ipcpath);
+  ipcfd = -1;
+}
+
+void ipcremovemon(Monitor *m) {
+  if (m->ipcstatus.valid)
+    ipcemit(NULL, StatusMonitor, "monitor %s remove", m->wlr_output->name);
+}
+
+void ipcstatus(Monitor *m, const Status *now) {
+  /* Send the parts of the status of m that changed to their subscribers */
+  unsigned int changed = statuschanges(&m->ipcstatus, now);
+
+  if (!changed)
+    return;
+  if (!wl_list_empty(&ipcclients))
+    sendstatus(NULL, m, now, changed);
+  savestatus(&m->ipcstatus, now);
+}
+
+void setupipc(const char *display) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+  wl_list_init(&ipcclients);
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/dwl-%s.sock",
+               getenv("XDG_RUNTIME_DIR"),
+               display) >= (int)sizeof(addr.sun_path)) {
+    wlr_log(WLR_ERROR, "IPC socket path is too long, IPC is disabled");
+    return;
+  }
+  /* The Wayland socket is locked, so a socket left here is stale */
+  unlink(addr.sun_path);
+  if ((ipcfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      0)) < 0 ||
+      bind(ipcfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(ipcfd, 8) < 0) {
+    wlr_log_errno(WLR_ERROR, "can't create IPC socket, IPC is disabled");
+    if (ipcfd >= 0)
+      close(ipcfd);
+    ipcfd = -1;
+    return;
+  }
+  strcpy(ipcpath, addr.sun_path);
+  ipcsource = wl_event_loop_add_fd(wl_display_get_event_loop(dpy), ipcfd,
+                                   WL_EVENT_READABLE, ipcaccept, NULL);
+  setenv("DWL_SOCK", ipcpath, 1);
+}
@@ -0,0 +1,85 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_keyboard_group.h>
+
+/*
+ * Compiling a keymap takes milliseconds, so each set of rule names is
+ * compiled once and the keymap is shared by every keyboard using it.
+ * Physical keyboards sharing a keymap are also merged into one
+ * wlr_keyboard_group, which is the keyboard the seat sees: typing on another
+ * keyboard of the group neither switches the seat keyboard nor sends the
+ * keymap to the focused client again.
+ */
+
+static struct xkb_context *context;
+static struct wl_list keymaps; /* KeyMap::link */
+
+static int samestr(const char *a, const char *b) {
+  return a == b || (a && b && !strcmp(a, b));
+}
+
+static int samenames(const struct xkb_rule_names *a,
+                     const struct xkb_rule_names *b) {
+  return samestr(a->rules, b->rules) && samestr(a->model, b->model) &&
+         samestr(a->layout, b->layout) && samestr(a->variant, b->variant) &&
+         samestr(a->options, b->options);
+}
+
+void cleanupkeymaps(void) {
+  KeyMap *km, *tmp;
+
+  if (!context)
+    return;
+  wl_list_for_each_safe(km, tmp, &keymaps, link) {
+    wl_list_remove(&km->link);
+    wl_list_remove(&km->kb.modifiers.link);
+    wl_list_remove(&km->kb.key.link);
+    wlr_keyboard_group_destroy(km->group);
+    xkb_keymap_unref(km->keymap);
+    free(km);
+  }
+  xkb_context_unref(context);
+  context = NULL;
+}
+
+KeyMap *keymapfor(const struct xkb_rule_names *names) {
+  /* names must stay valid for as long as the keymap is cached */
+  KeyMap *km;
+  struct xkb_keymap *keymap;
+
+  if (!context) {
+    context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    wl_list_init(&keymaps);
+  }
+  wl_list_for_each(km, &keymaps, link) {
+    if (samenames(&km->names, names))
+      return km;
+  }
+
+  if (!(keymap = xkb_map_new_from_names(context, names,
+                                        XKB_KEYMAP_COMPILE_NO_FLAGS)))
+    BARF("failed to compile keymap");
+  km = calloc(1, sizeof(*km));
+  km->names = *names;
+  km->keymap = keymap;
+
+  /* The group forwards the events of all its keyboards */
+  km->group = wlr_keyboard_group_create();
+  km->group->data = km;
+  wlr_keyboard_set_keymap(&km->group->keyboard, keymap);
+  wlr_keyboard_set_repeat_info(&km->group->keyboard, repeat_rate,
+                               repeat_delay);
+  km->kb.device = km->group->input_device;
+  wl_list_init(&km->kb.link);
+  wl_list_init(&km->kb.destroy.link);
+  LISTEN(&km->group->keyboard.events.modifiers, &km->kb.modifiers,
+         keypressmod);
+  LISTEN(&km->group->keyboard.events.key, &km->kb.key, keypress);
+
+  wl_list_insert(&keymaps, &km->link);
+  return km;
+}
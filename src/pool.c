@@ -0,0 +1,121 @@
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
+
+/*
+ * Clients, layer surfaces, keyboards, monitors and surface damage trackers
+ * come and go all the time with menus and tooltips, so each type is carved
+ * out of slabs of its own instead of going through malloc every time.
+ * Objects start on a cache line and take up whole cache lines, and freed
+ * objects are reused most recently freed first, while still warm.
+ *
+ * With POOLDEBUG, freed objects are poisoned; writes to them after they are
+ * freed and double frees are logged. Pool statistics, including objects
+ * that are still allocated, can be queried with the "pools" IPC command
+ * and leaks are logged on exit.
+ */
+
+#define CACHELINE 64
+#define SLABSIZE (16 * 1024)
+#define POISON 0x6b
+
+static size_t objsize(const Pool *p) {
+  return (p->size + CACHELINE - 1) / CACHELINE * CACHELINE;
+}
+
+#ifdef POOLDEBUG
+static int poisoned(const Pool *p, const void *obj) {
+  /* The first word links the free list and is left out */
+  const unsigned char *b = obj;
+  size_t i;
+
+  for (i = sizeof(void *); i < objsize(p); i++) {
+    if (b[i] != POISON)
+      return 0;
+  }
+  return 1;
+}
+#endif
+
+static void addslab(Pool *p) {
+  size_t step = objsize(p), n = MAX((SLABSIZE - CACHELINE) / step, 1), i;
+  char *slab, *obj;
+
+  /* The first cache line of a slab links it to the next one */
+  if (!(slab = aligned_alloc(CACHELINE, CACHELINE + n * step)))
+    EBARF("can't allocate %s slab", p->name);
+  *(void **)slab = p->slabs;
+  p->slabs = slab;
+  if (!p->nslabs++) {
+    p->next = pools;
+    pools = p;
+  }
+
+  /* Hand out the objects in address order */
+  for (i = n; i-- > 0;) {
+    obj = slab + CACHELINE + i * step;
+#ifdef POOLDEBUG
+    memset(obj, POISON, step);
+#endif
+    *(void **)obj = p->free;
+    p->free = obj;
+  }
+  p->nfree += n;
+}
+
+void cleanuppools(void) {
+  Pool *p;
+  void *slab;
+
+  for (p = pools; p; p = p->next) {
+    if (p->live)
+      wlr_log(WLR_ERROR, "%zu %s objects were never freed", p->live,
+              p->name);
+    while ((slab = p->slabs)) {
+      p->slabs = *(void **)slab;
+      free(slab);
+    }
+    p->free = NULL;
+    p->nslabs = p->nfree = p->live = 0;
+  }
+  pools = NULL;
+}
+
+void *poolalloc(Pool *p) {
+  /* Returns a zeroed object, like calloc(1, p->size) */
+  void *obj;
+
+  if (!p->free)
+    addslab(p);
+  obj = p->free;
+  p->free = *(void **)obj;
+  p->nfree--;
+  p->live++;
+  p->allocs++;
+#ifdef POOLDEBUG
+  if (!poisoned(p, obj))
+    wlr_log(WLR_ERROR, "%s %p was written to after it was freed", p->name,
+            obj);
+#endif
+  return memset(obj, 0, p->size);
+}
+
+void poolfree(Pool *p, void *obj) {
+  if (!obj)
+    return;
+#ifdef POOLDEBUG
+  if (poisoned(p, obj)) {
+    wlr_log(WLR_ERROR, "%s %p was freed twice", p->name, obj);
+    return;
+  }
+  memset(obj, POISON, objsize(p));
+#endif
+  *(void **)obj = p->free;
+  p->free = obj;
+  p->nfree++;
+  p->live--;
+}
@@ -0,0 +1,233 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "client.h"
+
+/*
+ * A rule matches when its app_id and title patterns are both substrings of
+ * those of the client. Instead of calling strstr() for every rule, the
+ * distinct app_id and title patterns are each compiled into an Aho-Corasick
+ * automaton at startup, which finds all patterns in a string in one pass
+ * over it. Rules are then applied in table order as before, and monitor
+ * numbers are looked up in an array of the monitors, see indexmons().
+ */
+
+typedef struct {
+  int child, sibling; /* trie edges, sorted by byte */
+  int fail;           /* longest proper suffix that is in the trie */
+  int dict;           /* nearest node on the fail chain ending a pattern */
+  int pattern;        /* pattern ending here, or -1 */
+  unsigned char c;    /* byte on the edge from the parent */
+} AcNode;
+
+typedef struct {
+  AcNode *nodes; /* nodes[0] is the root */
+  int nnodes, maxnodes;
+  int first[LENGTH(rules)]; /* first rule using each pattern, or -1 */
+  int next[LENGTH(rules)];  /* next rule using the same pattern, or -1 */
+  char any[LENGTH(rules)];  /* the rule has no pattern here */
+  int npatterns;
+} Automaton;
+
+static Automaton appids, titles;
+static Monitor **monindex; /* mons by their number in rules[] */
+static size_t nmonindex, maxmonindex;
+
+static int acnode(Automaton *a, int parent, unsigned char c) {
+  /* Returns the child of parent for c, adding it if needed */
+  int *link, n;
+
+  if (a->nnodes == a->maxnodes) {
+    a->maxnodes *= 2;
+    a->nodes = realloc(a->nodes, a->maxnodes * sizeof(*a->nodes));
+  }
+  link = &a->nodes[parent].child;
+  while (*link && a->nodes[*link].c < c)
+    link = &a->nodes[*link].sibling;
+  if (*link && a->nodes[*link].c == c)
+    return *link;
+
+  n = a->nnodes++;
+  a->nodes[n] = (AcNode){.sibling = *link, .pattern = -1, .c = c};
+  *link = n;
+  return n;
+}
+
+static int acgoto(const Automaton *a, int n, unsigned char c) {
+  /* Follows the edge for c from n, or 0 */
+  for (n = a->nodes[n].child; n && a->nodes[n].c < c; n = a->nodes[n].sibling)
+    ;
+  return n && a->nodes[n].c == c ? n : 0;
+}
+
+static int acstep(const Automaton *a, int n, unsigned char c) {
+  int next;
+
+  while (!(next = acgoto(a, n, c)) && n)
+    n = a->nodes[n].fail;
+  return next;
+}
+
+static void acadd(Automaton *a, int rule, const char *pattern) {
+  int n = 0, *link;
+
+  /* An empty pattern matches anything, like no pattern */
+  if (!pattern || !*pattern) {
+    a->any[rule] = 1;
+    return;
+  }
+  if (!a->nodes) {
+    a->nodes = calloc(a->maxnodes = 64, sizeof(*a->nodes));
+    a->nodes[0].pattern = -1;
+    a->nnodes = 1;
+  }
+  for (; *pattern; pattern++)
+    n = acnode(a, n, *pattern);
+  if (a->nodes[n].pattern < 0) {
+    a->nodes[n].pattern = a->npatterns++;
+    a->first[a->nodes[n].pattern] = -1;
+  }
+
+  /* Rules stay in table order in the list of their pattern */
+  a->next[rule] = -1;
+  for (link = &a->first[a->nodes[n].pattern]; *link >= 0;
+       link = &a->next[*link])
+    ;
+  *link = rule;
+}
+
+static void acbuild(Automaton *a) {
+  /* Fill in fail and dict links, breadth first from the root */
+  int *queue, head = 0, tail = 0, n, child, f;
+
+  if (!a->nodes)
+    return;
+  queue = malloc(a->nnodes * sizeof(*queue));
+  for (child = a->nodes[0].child; child; child = a->nodes[child].sibling) {
+    a->nodes[child].fail = a->nodes[child].dict = 0;
+    queue[tail++] = child;
+  }
+  while (head < tail) {
+    n = queue[head++];
+    for (child = a->nodes[n].child; child; child = a->nodes[child].sibling) {
+      f = acstep(a, a->nodes[n].fail, a->nodes[child].c);
+      a->nodes[child].fail = f;
+      a->nodes[child].dict = a->nodes[f].pattern >= 0 ? f : a->nodes[f].dict;
+      queue[tail++] = child;
+    }
+  }
+  free(queue);
+}
+
+static void acmatch(const Automaton *a, const char *s, char *matched) {
+  /* Sets matched[r] for every rule r whose pattern occurs in s */
+  int n = 0, hit, r;
+
+  memcpy(matched, a->any, sizeof(a->any));
+  if (!a->nodes)
+    return;
+  for (; *s; s++) {
+    n = acstep(a, n, *s);
+    for (hit = a->nodes[n].pattern >= 0 ? n : a->nodes[n].dict; hit;
+         hit = a->nodes[hit].dict) {
+      for (r = a->first[a->nodes[hit].pattern]; r >= 0; r = a->next[r])
+        matched[r] = 1;
+    }
+  }
+}
+
+static void matchrules(Client *c) {
+  /* Sets the rule* fields of c to the outcome of the rules matching it */
+  const char *appid, *title;
+  char idmatch[LENGTH(rules)], titlematch[LENGTH(rules)];
+  const Rule *r;
+
+  c->rulefloating = client_is_float_type(c);
+  c->ruletags = 0;
+  c->rulemon = NULL; /* no rule picked a monitor */
+  if (!(appid = client_get_appid(c)))
+    appid = broken;
+  if (!(title = client_get_title(c)))
+    title = broken;
+
+  acmatch(&appids, appid, idmatch);
+  acmatch(&titles, title, titlematch);
+  for (r = rules; r < END(rules); r++) {
+    if (!idmatch[r - rules] || !titlematch[r - rules])
+      continue;
+    c->rulefloating = r->isfloating;
+    c->ruletags |= r->tags;
+    if (r->monitor >= 0 && (size_t)r->monitor < nmonindex)
+      c->rulemon = monindex[r->monitor];
+  }
+}
+
+void applyrules(Client *c) {
+  /* rule matching */
+  matchrules(c);
+  c->isfloating = c->rulefloating;
+  setmon(c, c->rulemon ? c->rulemon : selmon, c->ruletags);
+}
+
+void indexmons(void) {
+  /* Number the monitors the way rules[] refers to them */
+  Monitor *m;
+
+  nmonindex = 0;
+  wl_list_for_each(m, &mons, link) {
+    if (nmonindex == maxmonindex) {
+      maxmonindex = maxmonindex ? maxmonindex * 2 : 4;
+      monindex = realloc(monindex, maxmonindex * sizeof(*monindex));
+    }
+    monindex[nmonindex++] = m;
+  }
+}
+
+void reapplyrules(Client *c, int title) {
+  /* With dynamicrules, apply the rules again after the title or app_id of a
+   * mapped client changed. Only what the outcome of the rules changed is
+   * applied, so changes made by hand stay until the rules disagree. */
+  unsigned int tags = c->ruletags;
+  int floating = c->rulefloating;
+  Monitor *mon = c->rulemon;
+
+  if (!dynamicrules || !c->mon || client_is_unmanaged(c))
+    return;
+  /* Titles can change many times a second; they only matter to rules with
+   * a title pattern */
+  if (title && !titles.npatterns)
+    return;
+
+  matchrules(c);
+  if (c->rulefloating == floating && c->ruletags == tags &&
+      c->rulemon == mon)
+    return;
+
+  if (c->rulefloating != floating)
+    setfloating(c, c->rulefloating);
+  /* Clients only move when a rule names their monitor */
+  if (c->rulemon && c->rulemon != mon && c->rulemon != c->mon) {
+    setmon(c, c->rulemon, c->ruletags);
+  } else if (c->ruletags != tags && c->ruletags &&
+             c->ruletags != c->tags) {
+    settags(c, c->ruletags);
+    focusclient(focustop(selmon), 1);
+    arrange(c->mon);
+  }
+  printstatus();
+}
+
+void setuprules(void) {
+  const Rule *r;
+
+  for (r = rules; r < END(rules); r++) {
+    acadd(&appids, r - rules, r->id);
+    acadd(&titles, r - rules, r->title);
+  }
+  acbuild(&appids);
+  acbuild(&titles);
+}
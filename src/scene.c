@@ -0,0 +1,174 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "client.h"
+
+/*
+ * What is drawn on a monitor is kept in an array of nodes, bottom to top:
+ * background and bottom layer surfaces, client borders and surfaces,
+ * independents, top and overlay layer surfaces. Nodes hold output-local
+ * positions and borders already scaled, so a frame walks the array instead of
+ * the stacking and layer lists with a layout lookup for every surface. The
+ * array is rebuilt before the next frame after anything on it moved, was
+ * resized, restacked, shown or hidden, or changed its border color, see
+ * scenechanged(). Subsurfaces and popups are still found by walking the
+ * surface tree of a node when it is drawn, as wlroots moves them on commits.
+ */
+
+/* Bumped on every change; monitors with an older copy rebuild their scene */
+static unsigned int scenegen = 1;
+
+static SceneNode *addnode(Monitor *m, int type) {
+  if (m->nscene == m->maxscene) {
+    m->maxscene = m->maxscene ? m->maxscene * 2 : 32;
+    m->scene = realloc(m->scene, m->maxscene * sizeof(*m->scene));
+  }
+  m->scene[m->nscene] = (SceneNode){.type = type};
+  return &m->scene[m->nscene++];
+}
+
+static void addlayer(Monitor *m, struct wl_list *layer_surfaces) {
+  LayerSurface *layersurface;
+  SceneNode *node;
+
+  wl_list_for_each(layersurface, layer_surfaces, link) {
+    if (!layersurface->layer_surface->mapped)
+      continue;
+    node = addnode(m, SceneSurfaces);
+    node->surface = layersurface->layer_surface->surface;
+    node->box.x = layersurface->geo.x - m->m.x;
+    node->box.y = layersurface->geo.y - m->m.y;
+    node->framedone = 1;
+  }
+}
+
+static void addclient(Monitor *m, Client *c, const float *color) {
+  int saved = !wl_list_empty(&c->saved);
+  int i, x = c->current.x - m->m.x, y = c->current.y - m->m.y, w, h;
+  struct wlr_box *borders;
+  SceneNode *node;
+
+  if (c->bw) {
+    w = saved ? c->savedwidth : client_surface(c)->current.width;
+    h = saved ? c->savedheight : client_surface(c)->current.height;
+    borders = (struct wlr_box[4]){
+        {x, y, w + 2 * c->bw, c->bw},             /* top */
+        {x, y + c->bw, c->bw, h},                 /* left */
+        {x + c->bw + w, y + c->bw, c->bw, h},     /* right */
+        {x, y + c->bw + h, w + 2 * c->bw, c->bw}, /* bottom */
+    };
+    for (i = 0; i < 4; i++) {
+      node = addnode(m, SceneRect);
+      node->box = borders[i];
+      scalebox(&node->box, m->wlr_output->scale);
+      node->color = color;
+      node->c = c;
+    }
+  }
+
+  /* While a transaction is open, the client is shown as it was before */
+  node = addnode(m, saved ? SceneSaved : SceneSurfaces);
+  node->box.x = x + c->bw;
+  node->box.y = y + c->bw;
+  node->c = c;
+  node->framedone = framemon(&c->current) == m;
+}
+
+static void buildscene(Monitor *m) {
+  Client *c, *sel = selclient();
+  SceneNode *node;
+
+  m->nscene = 0;
+  m->scenegen = scenegen;
+
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+  m->sceneclients = m->nscene;
+
+  /* Each subsequent window we render is rendered on top of the last. Because
+   * our stacking list is ordered front-to-back, we iterate over it backwards.
+   */
+  wl_list_for_each_reverse(c, &stack, slink) {
+    if (!VISIBLEON(c, c->mon))
+      continue;
+    /* A client waiting to be shown for the first time still needs frame
+     * callbacks to draw the size it was given */
+    if (!c->current.width) {
+      if (framemon(&c->geom) == m)
+        addnode(m, SceneFrame)->c = c;
+      continue;
+    }
+    if (monintersects(m, &c->current))
+      addclient(m, c, c == sel ? focuscolor : bordercolor);
+  }
+
+#ifdef XWAYLAND
+  wl_list_for_each_reverse(c, &independents, link) {
+    struct wlr_box geom = {c->surface.xwayland->x, c->surface.xwayland->y,
+                           c->surface.xwayland->width,
+                           c->surface.xwayland->height};
+    if (!monintersects(m, &geom))
+      continue;
+    node = addnode(m, SceneSurfaces);
+    node->surface = c->surface.xwayland->surface;
+    node->box.x = geom.x - m->m.x;
+    node->box.y = geom.y - m->m.y;
+    node->framedone = framemon(&geom) == m;
+  }
+#endif
+
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+  addlayer(m, &m->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+}
+
+static void rendernodes(Monitor *m, SceneNode *node, SceneNode *end,
+                        struct timespec *now, pixman_region32_t *damage) {
+  struct render_data rdata = {
+      .output = m->wlr_output, .when = now, .damage = damage};
+
+  for (; node < end; node++) {
+    /* Clients hidden behind others are not drawn, see cullclients() */
+    if (node->type != SceneFrame && node->c && node->c->occluded)
+      continue;
+    switch (node->type) {
+    case SceneRect:
+      renderrect(m->wlr_output, &node->box, node->color, damage);
+      break;
+    case SceneSurfaces:
+      rdata.x = node->box.x;
+      rdata.y = node->box.y;
+      rdata.framedone = node->framedone;
+      /* This calls our render function for each surface among the
+       * xdg_surface's toplevel and popups, see clientsurfaces(). */
+      if (node->c)
+        clientsurfaces(node->c, render, &rdata);
+      else
+        wlr_surface_for_each_surface(node->surface, render, &rdata);
+      break;
+    case SceneSaved:
+      rendersaved(node->c, m->wlr_output, node->box.x, node->box.y, damage);
+      if (node->framedone)
+        clientsurfaces(node->c, sendframedone, now);
+      break;
+    case SceneFrame:
+      clientsurfaces(node->c, sendframedone, now);
+      break;
+    }
+  }
+}
+
+void renderscene(Monitor *m, struct timespec *now, pixman_region32_t *below,
+                 pixman_region32_t *damage) {
+  /* Layers under the clients are only drawn where below is damaged */
+  if (m->scenegen != scenegen)
+    buildscene(m);
+  rendernodes(m, m->scene, m->scene + m->sceneclients, now, below);
+  rendernodes(m, m->scene + m->sceneclients, m->scene + m->nscene, now,
+              damage);
+}
+
+void scenechanged(void) { scenegen++; }
@@ -28,6 +28,7 @@ void setup(void) {
   sigchld(0);
   signal(SIGINT, quitsignal);
   signal(SIGTERM, quitsignal);
+  setupstats();
 
   /* The backend is a wlroots feature which abstracts the underlying input and
    * output hardware. The autocreate option will choose the most suitable
@@ -53,6 +54,7 @@ void setup(void) {
    * the clients cannot set the selection directly without compositor approval,
    * see the setsel() function. */
   compositor = wlr_compositor_create(dpy, drw);
+  wl_signal_add(&compositor->events.new_surface, &new_surface);
   wlr_export_dmabuf_manager_v1_create(dpy);
   wlr_screencopy_manager_v1_create(dpy);
   wlr_data_control_manager_v1_create(dpy);
@@ -132,6 +134,11 @@ void setup(void) {
   wl_signal_add(&cursor->events.axis, &cursor_axis);
   wl_signal_add(&cursor->events.frame, &cursor_frame);
 
+  /* Sort keys[] and buttons[] for looking up bindings */
+  setupbindings();
+  /* Compile the patterns of rules[] */
+  setuprules();
+
   /*
    * Configures a seat, which is a single "seat" at which a user sits and
    * operates the computer. This conceptually includes up to one keyboard,
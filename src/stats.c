@@ -0,0 +1,150 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "client.h"
+
+/*
+ * Each monitor counts how long its frames take to render, how long a commit
+ * takes to be presented and how long its clients take to draw the size they
+ * were configured to, along with frames shown while a transaction waited for
+ * clients and transactions given up on, and whether a client is shown by
+ * direct scanout. Durations go into histograms with buckets a sixteenth of a
+ * power of two wide, so recording a sample is a couple of shifts and an
+ * increment and percentiles are off by at most 1/16. The ack histogram
+ * merges all clients of the monitor; each client also keeps its last and
+ * largest ack latency, to tell which one holds transactions up.
+ * The numbers can be queried with the "stats" IPC command and are written to
+ * stderr on SIGUSR1.
+ */
+
+#define SUBBITS 4
+#define SUBBUCKETS (1 << SUBBITS)
+
+static struct wl_event_source *dumpsource;
+
+static int bucket(uint32_t us) {
+  /* Values below SUBBUCKETS are exact; above, the bits below the top
+   * SUBBITS + 1 are dropped */
+  int e;
+
+  if (us < SUBBUCKETS)
+    return us;
+  e = 31 - __builtin_clz(us);
+  return (e - SUBBITS + 1) * SUBBUCKETS +
+         ((us >> (e - SUBBITS)) & (SUBBUCKETS - 1));
+}
+
+static uint32_t bucketmax(int b) {
+  /* The largest value counted in bucket b */
+  int e = b / SUBBUCKETS + SUBBITS - 1;
+
+  if (b < SUBBUCKETS)
+    return b;
+  return ((uint32_t)(SUBBUCKETS + b % SUBBUCKETS) << (e - SUBBITS)) +
+         ((uint32_t)1 << (e - SUBBITS)) - 1;
+}
+
+static uint32_t percentile(const Histogram *h, int pct) {
+  uint64_t rank = ((uint64_t)h->count * pct + 99) / 100, seen = 0;
+  int b;
+
+  for (b = 0; b < LENGTH(h->buckets); b++) {
+    if ((seen += h->buckets[b]) >= rank && seen)
+      return MIN(bucketmax(b), h->max);
+  }
+  return h->max;
+}
+
+static void formathist(void (*line)(const char *, void *), void *data,
+                       const Monitor *m, const char *name,
+                       const Histogram *h) {
+  char buf[256];
+
+  snprintf(buf, sizeof(buf),
+           "stats %s %s count %u avg %lu p50 %u p90 %u p99 %u max %u",
+           m->wlr_output->name, name, h->count,
+           h->count ? (unsigned long)(h->sum / h->count) : 0,
+           percentile(h, 50), percentile(h, 90), percentile(h, 99), h->max);
+  line(buf, data);
+}
+
+void formatstats(void (*line)(const char *, void *), void *data) {
+  /* Calls line for each line of statistics; durations are in us */
+  Monitor *m;
+  Client *c;
+  const char *appid;
+  char buf[256];
+
+  wl_list_for_each(m, &mons, link) {
+    formathist(line, data, m, "render", &m->renderhist);
+    formathist(line, data, m, "present", &m->presenthist);
+    formathist(line, data, m, "ack", &m->ackhist);
+    snprintf(buf, sizeof(buf),
+             "stats %s stalled %u expired %u failed %u scanout %d",
+             m->wlr_output->name, m->stalled, m->expired, m->commitfails,
+             m->scanout);
+    line(buf, data);
+    wl_list_for_each(c, &m->clients, mlink) {
+      if (!c->ackmax)
+        continue;
+      if (!(appid = client_get_appid(c)))
+        appid = broken;
+      snprintf(buf, sizeof(buf), "stats %s client ack last %u max %u %s",
+               m->wlr_output->name, c->acklast, c->ackmax, appid);
+      line(buf, data);
+    }
+  }
+}
+
+void recordack(Client *c) {
+  /* Called when c acks the configure of its pending resize */
+  uint32_t us = recordsince(&c->mon->ackhist, &c->configured);
+
+  c->acklast = us;
+  c->ackmax = MAX(c->ackmax, us);
+}
+
+uint32_t recordtime(Histogram *h, int64_t ns) {
+  /* Returns the sample as recorded, in us */
+  uint32_t us = ns <= 0 ? 0 : MIN(ns / 1000, UINT32_MAX);
+
+  h->buckets[bucket(us)]++;
+  h->count++;
+  h->sum += us;
+  h->max = MAX(h->max, us);
+  return us;
+}
+
+uint32_t recordsince(Histogram *h, const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return recordtime(h, TIMESPEC_NSEC(&now) - TIMESPEC_NSEC(start));
+}
+
+static void printline(const char *line, void *data) {
+  fprintf(stderr, "%s\n", line);
+}
+
+static int dumpstats(int signo, void *data) {
+  TRACE();
+  formatstats(printline, NULL);
+  return 0;
+}
+
+void cleanupstats(void) {
+  if (dumpsource)
+    wl_event_source_remove(dumpsource);
+}
+
+void setupstats(void) {
+  /* The signal is read from the event loop, where it is safe to print */
+  dumpsource = wl_event_loop_add_signal(wl_display_get_event_loop(dpy),
+                                        SIGUSR1, dumpstats, NULL);
+}
@@ -0,0 +1,196 @@
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client.h"
+
+/*
+ * Status lines are queued in a ring buffer and written to stdout without
+ * blocking; when the reader falls behind, the rest is written once stdout
+ * is writable again. No new lines are queued while old ones are waiting:
+ * they would only describe states that are superseded by the time they are
+ * read, so the state as it is then is printed once the reader catches up.
+ */
+
+#define STATUSBUFSIZE 8192
+#define STATUSLINESIZE 1024 /* longer lines are cut, so a monitor always fits */
+
+static char statusbuf[STATUSBUFSIZE];
+static size_t statushead, statuslen;
+static int statusstale; /* lines were held back or did not fit */
+static int statusdead;  /* the reader is gone */
+static struct wl_event_source *statusout;
+
+static int statusprintf(const char *fmt, ...) {
+  /* Queue a whole line, or nothing if the ring is too full for it */
+  char line[STATUSLINESIZE];
+  va_list ap;
+  size_t tail, n;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return 0;
+  if ((size_t)len >= sizeof(line)) {
+    len = sizeof(line) - 1;
+    line[len - 1] = '\n';
+  }
+  if ((size_t)len > sizeof(statusbuf) - statuslen)
+    return 0;
+
+  tail = (statushead + statuslen) % sizeof(statusbuf);
+  n = MIN((size_t)len, sizeof(statusbuf) - tail);
+  memcpy(statusbuf + tail, line, n);
+  memcpy(statusbuf, line + n, len - n);
+  statuslen += len;
+  return 1;
+}
+
+static void writestatus(void) {
+  ssize_t n;
+
+  while (statuslen) {
+    n = write(STDOUT_FILENO, statusbuf + statushead,
+              MIN(statuslen, sizeof(statusbuf) - statushead));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!statusout)
+        statusout =
+            wl_event_loop_add_fd(wl_display_get_event_loop(dpy), STDOUT_FILENO,
+                                 WL_EVENT_WRITABLE, statuswritable, NULL);
+      else
+        wl_event_source_fd_update(statusout, WL_EVENT_WRITABLE);
+      return;
+    }
+    if (n < 0) {
+      /* Nobody reads the status anymore, stop producing it */
+      statusdead = 1;
+      statuslen = 0;
+      break;
+    }
+    statushead = (statushead + n) % sizeof(statusbuf);
+    statuslen -= n;
+  }
+  statushead = 0;
+  if (statusout)
+    wl_event_source_fd_update(statusout, 0);
+  if (statusstale && !statusdead) {
+    statusstale = 0;
+    printstatus();
+  }
+}
+
+void flushstatus(void *data) {
+  /* Send the status of each monitor to whatever differs from it; new
+   * monitors are sent in full. */
+  TRACE();
+  Monitor *m;
+  Client *c;
+  Status now;
+  unsigned int changed;
+  int held, queued;
+
+  pendingstatus = NULL;
+  /* Lines still waiting for the reader would be superseded by these */
+  if ((held = statuslen > 0))
+    statusstale = 1;
+
+  wl_list_for_each(m, &mons, link) {
+    c = focustop(m);
+    now.title = c ? client_get_title(c) : NULL;
+    if (!now.title)
+      now.title = "";
+    now.selmon = m == selmon;
+    now.occ = countedtags(m->occ);
+    now.tags = m->tagset[m->seltags];
+    now.sel = c ? c->tags : 0;
+    now.urg = countedtags(m->urg);
+    now.layout = m->lt[m->sellt]->symbol;
+
+    ipcstatus(m, &now);
+    if (held || statusdead)
+      continue;
+
+    changed = statuschanges(&m->status, &now);
+    queued = 1;
+    if (changed & 1 << StatusTitle)
+      queued &= statusprintf("%s title %s\n", m->wlr_output->name, now.title);
+    if (changed & 1 << StatusFocus)
+      queued &= statusprintf("%s selmon %u\n", m->wlr_output->name,
+                             now.selmon);
+    if (changed & 1 << StatusTags)
+      queued &= statusprintf("%s tags %u %u %u %u\n", m->wlr_output->name,
+                             now.occ, now.tags, now.sel, now.urg);
+    if (changed & 1 << StatusLayout)
+      queued &= statusprintf("%s layout %s\n", m->wlr_output->name,
+                             now.layout);
+
+    if (!queued) {
+      /* Out of room: print all of m again once the ring has drained */
+      free((char *)m->status.title);
+      memset(&m->status, 0, sizeof(m->status));
+      statusstale = 1;
+      continue;
+    }
+    savestatus(&m->status, &now);
+  }
+  if (!held)
+    writestatus();
+}
+
+void printstatus(void) {
+  /* Focus changes come in bursts; print what changed once they are over */
+  if (!pendingstatus)
+    pendingstatus = wl_event_loop_add_idle(wl_display_get_event_loop(dpy),
+                                           flushstatus, NULL);
+}
+
+void savestatus(Status *st, const Status *now) {
+  /* Remember now as sent; its title is copied */
+  const char *title = st->title;
+
+  if (!title || strcmp(title, now->title)) {
+    free((char *)title);
+    title = strdup(now->title);
+  }
+  *st = *now;
+  st->title = title;
+  st->valid = 1;
+}
+
+unsigned int statuschanges(const Status *st, const Status *now) {
+  /* Mask of the Status* parts of now that differ from st */
+  unsigned int changed = 0;
+
+  if (!st->valid)
+    return ~0u;
+  if (strcmp(st->title, now->title))
+    changed |= 1 << StatusTitle;
+  if (st->selmon != now->selmon)
+    changed |= 1 << StatusFocus;
+  if (st->occ != now->occ || st->tags != now->tags || st->sel != now->sel ||
+      st->urg != now->urg)
+    changed |= 1 << StatusTags;
+  if (strcmp(st->layout, now->layout))
+    changed |= 1 << StatusLayout;
+  return changed;
+}
+
+int statuswritable(int fd, uint32_t mask, void *data) {
+  TRACE();
+  if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+    statusdead = 1;
+    statuslen = 0;
+  }
+  writestatus();
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "client.h"
+
+/*
+ * Rendering, culling, frame callbacks and hit testing each walk the surfaces
+ * of a client: its subsurface tree and, for xdg-shell clients, every popup
+ * with its own subsurfaces. Each client keeps that walk flattened into an
+ * array of surfaces with their offsets, bottom to top, which is rebuilt on
+ * first use after a surface of the client was committed, see commitsurface(),
+ * or after any surface was destroyed. Subsurfaces and popups are created,
+ * restacked, moved and mapped by commits. They can also be unmapped by
+ * destroying their role object, which keeps the wl_surface and commits
+ * nothing, so those are watched as well, see trackrole().
+ */
+
+/* Bumped when any surface or role is destroyed; older trees may list it */
+static unsigned int treegen = 1;
+
+static void addsurface(struct wlr_surface *surface, int sx, int sy,
+                       void *data) {
+  Client *c = data;
+
+  if (c->nsurfaces == c->maxsurfaces) {
+    c->maxsurfaces = c->maxsurfaces ? c->maxsurfaces * 2 : 4;
+    c->surfaces = realloc(c->surfaces, c->maxsurfaces * sizeof(*c->surfaces));
+  }
+  c->surfaces[c->nsurfaces++] = (FlatSurface){surface, sx, sy};
+}
+
+static void buildtree(Client *c) {
+  c->nsurfaces = 0;
+  c->treegen = treegen;
+  client_for_each_surface(c, addsurface, c);
+}
+
+void clientsurfaces(Client *c, wlr_surface_iterator_func_t fn, void *data) {
+  /* Like client_for_each_surface(), bottom to top */
+  int i;
+
+  if (c->treegen != treegen)
+    buildtree(c);
+  for (i = 0; i < c->nsurfaces; i++)
+    fn(c->surfaces[i].surface, c->surfaces[i].x, c->surfaces[i].y, data);
+}
+
+struct wlr_surface *clientsurfaceat(Client *c, double cx, double cy,
+                                    double *sx, double *sy) {
+  /* Like client_surface_at(): the topmost surface taking input there */
+  FlatSurface *s;
+  int i;
+
+  if (c->treegen != treegen)
+    buildtree(c);
+  for (i = c->nsurfaces - 1; i >= 0; i--) {
+    s = &c->surfaces[i];
+    if (wlr_surface_point_accepts_input(s->surface, cx - s->x, cy - s->y)) {
+      *sx = cx - s->x;
+      *sy = cy - s->y;
+      return s->surface;
+    }
+  }
+  return NULL;
+}
+
+static void roledestroyed(struct wl_listener *listener, void *data) {
+  TRACE();
+  SurfaceRole *role = wl_container_of(listener, role, destroy);
+
+  wl_list_remove(&role->destroy.link);
+  wl_list_remove(&role->unmap.link);
+  poolfree(&rolepool, role);
+  treegen++;
+}
+
+static void roleunmapped(struct wl_listener *listener, void *data) {
+  TRACE();
+  treegen++;
+}
+
+/* new_subsurface */
+void createsubsurface(struct wl_listener *listener, void *data) {
+  TRACE();
+  struct wlr_subsurface *subsurface = data;
+
+  trackrole(&subsurface->events.destroy, &subsurface->events.unmap);
+}
+
+void surfacedestroyed(void) { treegen++; }
+
+void trackrole(struct wl_signal *destroy, struct wl_signal *unmap) {
+  /* Rebuilds every tree when the role is unmapped or destroyed; both are
+   * rare next to commits */
+  SurfaceRole *role = poolalloc(&rolepool);
+
+  LISTEN(destroy, &role->destroy, roledestroyed);
+  LISTEN(unmap, &role->unmap, roleunmapped);
+}
+
+void treechanged(Client *c) { c->treegen = 0; }
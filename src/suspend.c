@@ -0,0 +1,61 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <time.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "client.h"
+
+/*
+ * Clients on tags that are not shown are suspended. X11 clients are
+ * iconified, as dwm does with hidden windows. xdg-shell has no suspended
+ * state in this version of wlroots, so those clients are not told; the slow
+ * frame callbacks are their only hint. Hidden clients are not rendered and
+ * would never get a frame callback; they get one every suspendinterval ms
+ * instead, so that clients drawing from frame callbacks idle along rather
+ * than falling back to timers of their own.
+ */
+
+static struct wl_event_source *suspendtimer;
+static int nsuspended;
+
+static int suspendframe(void *data) {
+  TRACE();
+  Client *c;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  wl_list_for_each(c, &clients, link) {
+    if (c->suspended)
+      clientsurfaces(c, sendframedone, &now);
+  }
+  if (nsuspended)
+    wl_event_source_timer_update(suspendtimer, suspendinterval);
+  return 0;
+}
+
+void suspendclient(Client *c, int suspend) {
+  if (c->suspended == suspend)
+    return;
+  c->suspended = suspend;
+  client_set_suspended(c, suspend);
+
+  if (!suspend) {
+    nsuspended--;
+    return;
+  }
+  if (!suspendtimer)
+    suspendtimer = wl_event_loop_add_timer(wl_display_get_event_loop(dpy),
+                                           suspendframe, NULL);
+  if (!nsuspended++)
+    wl_event_source_timer_update(suspendtimer, suspendinterval);
+}
+
+void updatesuspended(Monitor *m) {
+  /* Suspend the clients of m that are hidden and resume those shown */
+  Client *c;
+
+  wl_list_for_each(c, &m->clients, mlink)
+    suspendclient(c, !VISIBLEON(c, m));
+}
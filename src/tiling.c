@@ -16,8 +16,10 @@ void tile(Monitor *m) {
   unsigned int i, n = 0, h, mw, my, ty;
   Client *c;
 
-  wl_list_for_each(c, &clients, link) if (VISIBLEON(c, m) && !c->isfloating)
+  wl_list_for_each(c, &m->clients, mlink) {
+    if (VISIBLEON(c, m) && !c->isfloating)
       n++;
+  }
   if (n == 0)
     return;
 
@@ -26,7 +28,7 @@ void tile(Monitor *m) {
   else
     mw = m->w.width;
   i = my = ty = 0;
-  wl_list_for_each(c, &clients, link) {
+  wl_list_for_each(c, &m->clients, mlink) {
     if (!VISIBLEON(c, m) || c->isfloating || c->isfullscreen)
       continue;
     if (i < m->nmaster) {
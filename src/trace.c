@@ -0,0 +1,105 @@
+#include "functions.h"
+#include "macros.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * While tracing is on, every handler that dwl runs from the event loop, and a
+ * few expensive functions called from them, records when it started and when
+ * it finished, see TRACE(). The last TRACEEVENTS of those spans are kept in a
+ * ring. "trace start" and "trace stop" over IPC turn tracing on and off, and
+ * "trace write PATH" saves the ring in the Chrome trace event format. Both
+ * chrome://tracing and Perfetto open that format, and it shows which handler
+ * held up the event loop and for how long. A handler called from another
+ * handler shows up nested inside it. While tracing is off, each handler
+ * costs one test.
+ */
+
+#define TRACEEVENTS (64 * 1024)
+
+typedef struct {
+  const char *name;
+  int64_t start, end; /* ns, CLOCK_MONOTONIC */
+} TraceEvent;
+
+static TraceEvent *events;
+static size_t nevents, nextevent;
+static int tracing;
+
+TraceSpan tracebegin(const char *name) {
+  TraceSpan span = {0};
+  struct timespec now;
+
+  if (!tracing)
+    return span;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  span.name = name;
+  span.start = TIMESPEC_NSEC(&now);
+  return span;
+}
+
+void traceend(TraceSpan *span) {
+  struct timespec now;
+  TraceEvent *e;
+
+  /* Spans begun before tracing was turned on are not recorded */
+  if (!span->name || !tracing)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  e = &events[nextevent];
+  e->name = span->name;
+  e->start = span->start;
+  e->end = TIMESPEC_NSEC(&now);
+  nextevent = (nextevent + 1) % TRACEEVENTS;
+  nevents = MIN(nevents + 1, TRACEEVENTS);
+}
+
+int tracestart(void) {
+  /* Starts over with an empty ring; returns -1 if it can't be allocated */
+  if (!events && !(events = calloc(TRACEEVENTS, sizeof(*events))))
+    return -1;
+  nevents = nextevent = 0;
+  tracing = 1;
+  return 0;
+}
+
+void tracestop(void) {
+  /* What was recorded is kept until tracing starts again */
+  tracing = 0;
+}
+
+int tracewrite(const char *path) {
+  /* Returns -1 with errno set on failure */
+  FILE *f;
+  TraceEvent *e;
+  size_t i;
+  int pid = getpid();
+
+  if (!(f = fopen(path, "w")))
+    return -1;
+  fputs("{\"traceEvents\":[", f);
+  for (i = 0; i < nevents; i++) {
+    e = &events[(nextevent + TRACEEVENTS - nevents + i) % TRACEEVENTS];
+    fprintf(f,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            i ? "," : "", e->name, pid, pid, e->start / 1e3,
+            (e->end - e->start) / 1e3);
+  }
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+  if (ferror(f)) {
+    fclose(f);
+    errno = EIO;
+    return -1;
+  }
+  return fclose(f);
+}
+
+void cleanuptrace(void) {
+  free(events);
+  events = NULL;
+  tracing = 0;
+}
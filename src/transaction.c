@@ -0,0 +1,150 @@
+#include "config.h"
+#include "functions.h"
+#include "macros.h"
+#include "variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+
+#include "client.h"
+
+/*
+ * Layout changes are applied atomically per monitor. Rearranging clients
+ * opens a transaction on their monitor: the new geometry goes to c->geom and
+ * the clients are asked to resize, while c->current and the buffers saved
+ * at that point keep being drawn. Once every client has committed a buffer
+ * for the size it was given, or txntimeout has passed, all clients of the
+ * monitor jump to their new geometry in the same frame.
+ */
+
+static void savebuffer(struct wlr_surface *surface, int sx, int sy,
+                       void *data) {
+  Client *c = data;
+  SavedBuffer *saved;
+
+  if (!wlr_surface_has_buffer(surface))
+    return;
+  saved = calloc(1, sizeof(*saved));
+  wlr_buffer_lock(&surface->buffer->base);
+  saved->buffer = surface->buffer;
+  saved->x = sx;
+  saved->y = sy;
+  saved->width = surface->current.width;
+  saved->height = surface->current.height;
+  saved->transform = surface->current.transform;
+  /* Keep the drawing order of the iterator, bottom to top */
+  wl_list_insert(c->saved.prev, &saved->link);
+  if (surface == client_surface(c)) {
+    c->savedwidth = saved->width;
+    c->savedheight = saved->height;
+  }
+}
+
+void applygeom(Client *c) {
+  /* Show c at the geometry it was given */
+  dropbuffers(c);
+  if (!memcmp(&c->current, &c->geom, sizeof(c->geom)))
+    return;
+  if (c->current.width)
+    damagebox(&c->current);
+  c->current = c->geom;
+  damageclient(c, NULL, 1);
+  scenechanged();
+}
+
+void dropbuffers(Client *c) {
+  SavedBuffer *saved, *tmp;
+
+  if (wl_list_empty(&c->saved))
+    return;
+  wl_list_for_each_safe(saved, tmp, &c->saved, link) {
+    wl_list_remove(&saved->link);
+    wlr_buffer_unlock(&saved->buffer->base);
+    free(saved);
+  }
+  /* What the client draws now may differ from what was saved */
+  damageclient(c, NULL, 1);
+  scenechanged();
+}
+
+void savebuffers(Client *c) {
+  /* Clients that were never shown have nothing to keep on screen */
+  if (!wl_list_empty(&c->saved) || !c->current.width)
+    return;
+  client_for_each_surface(c, savebuffer, c);
+  scenechanged();
+}
+
+void txnapply(Monitor *m) {
+  Client *c;
+
+  m->txn = 0;
+  wl_event_source_timer_update(m->txnexpire, 0);
+  wl_list_for_each(c, &m->clients, mlink)
+    applygeom(c);
+}
+
+void txncheck(Monitor *m) {
+  Client *c;
+
+  if (!m->txn)
+    return;
+  wl_list_for_each(c, &m->clients, mlink) {
+    if (c->resize)
+      return;
+  }
+  txnapply(m);
+}
+
+void txncommit(void *data) {
+  /* Everything that arranged m during this event loop iteration is done */
+  TRACE();
+  Monitor *m = data;
+
+  m->txncommit = NULL;
+  txncheck(m);
+}
+
+int txnexpire(void *data) {
+  TRACE();
+  Monitor *m = data;
+  Client *c;
+  int expired = 0;
+
+  wl_list_for_each(c, &m->clients, mlink) {
+    if (c->resize) {
+      wlr_log(WLR_DEBUG, "%s: client did not resize in time",
+              client_get_appid(c) ? client_get_appid(c) : "?");
+      c->resize = 0;
+      expired = 1;
+    }
+  }
+  m->expired += expired;
+  txnapply(m);
+  return 0;
+}
+
+void txnopen(Monitor *m) {
+  Client *c;
+
+  if (!m)
+    return;
+  /* Hold on to what is shown now; clients that show up while the
+   * transaction is open are kept as they are as well. */
+  wl_list_for_each(c, &m->clients, mlink) {
+    if (VISIBLEON(c, m))
+      savebuffers(c);
+  }
+  if (!m->txn) {
+    m->txn = 1;
+    wl_event_source_timer_update(m->txnexpire, txntimeout);
+    /* Clients may wait for a frame callback before drawing their new size */
+    wlr_output_schedule_frame(m->wlr_output);
+  }
+  if (!m->txncommit)
+    m->txncommit = wl_event_loop_add_idle(wl_display_get_event_loop(dpy),
+                                          txncommit, m);
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_idle.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_virtual_keyboard_v1.h>
 #include <wlr/types/wlr_xcursor_manager.h>
@@ -16,7 +17,9 @@
 void axisnotify(struct wl_listener *listener, void *data) {
   /* This event is forwarded by the cursor when a pointer emits an axis event,
    * for example when you move the scroll wheel. */
+  TRACE();
   struct wlr_event_pointer_axis *event = data;
+  flushmotion();
   wlr_idle_notify_activity(idle, seat);
   /* Notify the client with pointer focus of the axis event. */
   wlr_seat_pointer_notify_axis(seat, event->time_msec, event->orientation,
@@ -26,12 +29,13 @@ void axisnotify(struct wl_listener *listener, void *data) {
 
 /* cursor_button */
 void buttonpress(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_event_pointer_button *event = data;
   struct wlr_keyboard *keyboard;
   uint32_t mods;
   Client *c;
-  const Button *b;
 
+  flushmotion();
   wlr_idle_notify_activity(idle, seat);
 
   switch (event->state) {
@@ -42,18 +46,14 @@ void buttonpress(struct wl_listener *listener, void *data) {
 
     keyboard = wlr_seat_get_keyboard(seat);
     mods = wlr_keyboard_get_modifiers(keyboard);
-    for (b = buttons; b < END(buttons); b++) {
-      if (CLEANMASK(mods) == CLEANMASK(b->mod) && event->button == b->button &&
-          b->func) {
-        b->func(&b->arg);
-        return;
-      }
-    }
+    if (buttonbinding(mods, event->button))
+      return;
     break;
   case WLR_BUTTON_RELEASED:
     /* If you released any buttons, we exit interactive move/resize mode. */
     /* TODO should reset to the pointer focus's current setcursor */
     if (cursor_mode != CurNormal) {
+      movegrab();
       wlr_xcursor_manager_set_cursor_image(cursor_mgr, "left_ptr", cursor);
       cursor_mode = CurNormal;
       /* Drop the window off on its new monitor */
@@ -75,6 +75,9 @@ void cursorframe(struct wl_listener *listener, void *data) {
    * event. Frame events are sent after regular pointer events to group
    * multiple events together. For instance, two axis events may happen at the
    * same time, in which case a frame event won't be sent in between. */
+  TRACE();
+  /* Motion since the last frame is handled once, at its final position. */
+  flushmotion();
   /* Notify the client with pointer focus of the frame event. */
   wlr_seat_pointer_notify_frame(seat);
 }
@@ -83,6 +86,7 @@ void cursorframe(struct wl_listener *listener, void *data) {
 void motionrelative(struct wl_listener *listener, void *data) {
   /* This event is forwarded by the cursor when a pointer emits a _relative_
    * pointer motion event (i.e. a delta) */
+  TRACE();
   struct wlr_event_pointer_motion *event = data;
   /* The cursor doesn't move unless we tell it to. The cursor automatically
    * handles constraining the motion to the output layout, as well as any
@@ -90,7 +94,7 @@ void motionrelative(struct wl_listener *listener, void *data) {
    * generated the event. You can pass NULL for the device if you want to move
    * the cursor around without any input. */
   wlr_cursor_move(cursor, event->device, event->delta_x, event->delta_y);
-  motionnotify(event->time_msec);
+  queuemotion(event->time_msec);
 }
 
 /* cursor_motion_absolute */
@@ -101,9 +105,10 @@ void motionabsolute(struct wl_listener *listener, void *data) {
    * move the mouse over the window. You could enter the window from any edge,
    * so we have to warp the mouse there. There is also some hardware which
    * emits these events. */
+  TRACE();
   struct wlr_event_pointer_motion_absolute *event = data;
   wlr_cursor_warp_absolute(cursor, event->device, event->x, event->y);
-  motionnotify(event->time_msec);
+  queuemotion(event->time_msec);
 }
 
 /* layout_change */
@@ -115,6 +120,7 @@ void updatemons(struct wl_listener *listener, void *data) {
    * positions, focus, and the stored configuration in wlroots'
    * output-manager implementation.
    */
+  TRACE();
   struct wlr_output_configuration_v1 *config =
       wlr_output_configuration_v1_create();
   Monitor *m;
@@ -146,6 +152,7 @@ void updatemons(struct wl_listener *listener, void *data) {
 void inputdevice(struct wl_listener *listener, void *data) {
   /* This event is raised by the backend when a new input device becomes
    * available. */
+  TRACE();
   struct wlr_input_device *device = data;
   uint32_t caps;
 
@@ -173,6 +180,7 @@ void inputdevice(struct wl_listener *listener, void *data) {
 
 /* new_virtual_keyboard */
 void virtualkeyboard(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_virtual_keyboard_v1 *keyboard = data;
   struct wlr_input_device *device = &keyboard->input_device;
   createkeyboard(device);
@@ -182,14 +190,17 @@ void virtualkeyboard(struct wl_listener *listener, void *data) {
 void createmon(struct wl_listener *listener, void *data) {
   /* This event is raised by the backend when a new output (aka a display or
    * monitor) becomes available. */
+  TRACE();
   struct wlr_output *wlr_output = data;
   const MonitorRule *r;
-  Monitor *m = wlr_output->data = calloc(1, sizeof(*m));
+  Monitor *m = wlr_output->data = poolalloc(&monpool);
   m->wlr_output = wlr_output;
 
   /* Initialize monitor state using configured rules */
   for (size_t i = 0; i < LENGTH(m->layers); i++)
     wl_list_init(&m->layers[i]);
+  wl_list_init(&m->clients);
+  wl_list_init(&m->fstack);
   m->tagset[0] = m->tagset[1] = 1;
   for (r = monrules; r < END(monrules); r++) {
     if (!r->name || strstr(wlr_output->name, r->name)) {
@@ -199,6 +210,7 @@ void createmon(struct wl_listener *listener, void *data) {
       wlr_xcursor_manager_load(cursor_mgr, r->scale);
       m->lt[0] = m->lt[1] = r->lt;
       wlr_output_set_transform(wlr_output, r->rr);
+      m->maxrendertime = r->maxrendertime;
       break;
     }
   }
@@ -210,15 +222,26 @@ void createmon(struct wl_listener *listener, void *data) {
   wlr_output_set_mode(wlr_output, wlr_output_preferred_mode(wlr_output));
   wlr_output_enable_adaptive_sync(wlr_output, 1);
 
-  /* Set up event listeners */
-  LISTEN(&wlr_output->events.frame, &m->frame, rendermon);
+  /* Set up event listeners. The output damage helper emits frame events
+   * only when there is something to draw. It is created after our destroy
+   * listener so that cleanupmon() runs before wlroots tears it down. */
   LISTEN(&wlr_output->events.destroy, &m->destroy, cleanupmon);
+  m->damage = wlr_output_damage_create(wlr_output);
+  LISTEN(&m->damage->events.frame, &m->frame, rendermon);
+  m->retry =
+      wl_event_loop_add_timer(wl_display_get_event_loop(dpy), retryframe, m);
+  m->repaint =
+      wl_event_loop_add_timer(wl_display_get_event_loop(dpy), repaintmon, m);
+  m->txnexpire =
+      wl_event_loop_add_timer(wl_display_get_event_loop(dpy), txnexpire, m);
+  LISTEN(&wlr_output->events.present, &m->present, presentmon);
 
   wlr_output_enable(wlr_output, 1);
   if (!wlr_output_commit(wlr_output))
     return;
 
   wl_list_insert(&mons, &m->link);
+  indexmons();
   printstatus();
 
   /* Adds this to the output layout in the order it was configured in.
@@ -247,22 +270,28 @@ void createmon(struct wl_listener *listener, void *data) {
 void createnotify(struct wl_listener *listener, void *data) {
   /* This event is raised when wlr_xdg_shell receives a new xdg surface from a
    * client, either a toplevel (application window) or popup. */
+  TRACE();
   struct wlr_xdg_surface *xdg_surface = data;
   Client *c;
 
-  if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL)
+  if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+    trackrole(&xdg_surface->events.destroy, &xdg_surface->events.unmap);
     return;
+  }
 
   /* Allocate a Client for this surface */
-  c = xdg_surface->data = calloc(1, sizeof(*c));
+  c = xdg_surface->data = poolalloc(&clientpool);
   c->surface.xdg = xdg_surface;
   c->bw = borderpx;
+  wl_list_init(&c->saved);
 
   LISTEN(&xdg_surface->surface->events.commit, &c->commit, commitnotify);
   LISTEN(&xdg_surface->events.map, &c->map, mapnotify);
   LISTEN(&xdg_surface->events.unmap, &c->unmap, unmapnotify);
   LISTEN(&xdg_surface->events.destroy, &c->destroy, destroynotify);
   LISTEN(&xdg_surface->toplevel->events.set_title, &c->set_title, updatetitle);
+  LISTEN(&xdg_surface->toplevel->events.set_app_id, &c->set_app_id,
+         updateappid);
   LISTEN(&xdg_surface->toplevel->events.request_fullscreen, &c->fullscreen,
          fullscreennotify);
   c->isfullscreen = 0;
@@ -270,6 +299,7 @@ void createnotify(struct wl_listener *listener, void *data) {
 
 /* new_layer_shell_surface */
 void createlayersurface(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_layer_surface_v1 *wlr_layer_surface = data;
   LayerSurface *layersurface;
   Monitor *m;
@@ -279,7 +309,7 @@ void createlayersurface(struct wl_listener *listener, void *data) {
     wlr_layer_surface->output = selmon->wlr_output;
   }
 
-  layersurface = calloc(1, sizeof(LayerSurface));
+  layersurface = poolalloc(&layerpool);
   LISTEN(&wlr_layer_surface->surface->events.commit,
          &layersurface->surface_commit, commitlayersurfacenotify);
   LISTEN(&wlr_layer_surface->events.destroy, &layersurface->destroy,
@@ -306,18 +336,21 @@ void createlayersurface(struct wl_listener *listener, void *data) {
 
 /* output_mgr_apply */
 void outputmgrapply(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_output_configuration_v1 *config = data;
   outputmgrapplyortest(config, 0);
 }
 
 /* output_mgr_test */
 void outputmgrtest(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_output_configuration_v1 *config = data;
   outputmgrapplyortest(config, 1);
 }
 
 /* request_activate */
 void urgent(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_xdg_activation_v1_request_activate_event *event = data;
   Client *c;
 
@@ -325,7 +358,7 @@ void urgent(struct wl_listener *listener, void *data) {
     return;
   c = wlr_xdg_surface_from_wlr_surface(event->surface)->data;
   if (c != selclient()) {
-    c->isurgent = 1;
+    seturgent(c, 1);
     printstatus();
   }
 }
@@ -333,6 +366,7 @@ void urgent(struct wl_listener *listener, void *data) {
 /* request_cursor */
 void setcursor(struct wl_listener *listener, void *data) {
   /* This event is raised by the seat when a client provides a cursor image */
+  TRACE();
   struct wlr_seat_pointer_request_set_cursor_event *event = data;
   /* If we're "grabbing" the cursor, don't use the client's image */
   /* TODO still need to save the provided surface to restore later */
@@ -354,6 +388,7 @@ void setpsel(struct wl_listener *listener, void *data) {
    * usually when the user copies something. wlroots allows compositors to
    * ignore such requests if they so choose, but in dwl we always honor
    */
+  TRACE();
   struct wlr_seat_request_set_primary_selection_event *event = data;
   wlr_seat_set_primary_selection(seat, event->source, event->serial);
 }
@@ -364,6 +399,7 @@ void setsel(struct wl_listener *listener, void *data) {
    * usually when the user copies something. wlroots allows compositors to
    * ignore such requests if they so choose, but in dwl we always honor
    */
+  TRACE();
   struct wlr_seat_request_set_selection_event *event = data;
   wlr_seat_set_selection(seat, event->source, event->serial);
 }
@@ -372,18 +408,27 @@ void setsel(struct wl_listener *listener, void *data) {
 
 /* new_xwayland_surface */
 void createnotifyx11(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_xwayland_surface *xwayland_surface = data;
   Client *c;
-  wl_list_for_each(c, &clients,
-                   link) if (c->isfullscreen && VISIBLEON(c, c->mon))
-      setfullscreen(c, 0);
+  Monitor *m;
+
+  wl_list_for_each(m, &mons, link) {
+    if (!m->nfullscreen)
+      continue;
+    wl_list_for_each(c, &m->clients, mlink) {
+      if (c->isfullscreen && VISIBLEON(c, m))
+        setfullscreen(c, 0);
+    }
+  }
 
   /* Allocate a Client for this surface */
-  c = xwayland_surface->data = calloc(1, sizeof(*c));
+  c = xwayland_surface->data = poolalloc(&clientpool);
   c->surface.xwayland = xwayland_surface;
   c->type = xwayland_surface->override_redirect ? X11Unmanaged : X11Managed;
   c->bw = borderpx;
   c->isfullscreen = 0;
+  wl_list_init(&c->saved);
 
   /* Listen to the various events it can emit */
   LISTEN(&xwayland_surface->events.map, &c->map, mapnotify);
@@ -392,6 +437,7 @@ void createnotifyx11(struct wl_listener *listener, void *data) {
   LISTEN(&xwayland_surface->events.request_configure, &c->configure,
          configurex11);
   LISTEN(&xwayland_surface->events.set_title, &c->set_title, updatetitle);
+  LISTEN(&xwayland_surface->events.set_class, &c->set_app_id, updateappid);
   LISTEN(&xwayland_surface->events.destroy, &c->destroy, destroynotify);
   LISTEN(&xwayland_surface->events.request_fullscreen, &c->fullscreen,
          fullscreennotify);
@@ -399,6 +445,7 @@ void createnotifyx11(struct wl_listener *listener, void *data) {
 
 /* xwayland_ready */
 void xwaylandready(struct wl_listener *listener, void *data) {
+  TRACE();
   struct wlr_xcursor *xcursor;
   xcb_connection_t *xc = xcb_connect(xwayland->display_name, NULL);
   int err = xcb_connection_has_error(xc);